@@ -0,0 +1,105 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "bench.h"
+
+/* Amount of data each scenario moves per payload size */
+#define BENCH_VOLUME (256L * 1024L * 1024L)
+#define BENCH_MIN_ITERATIONS 50
+#define BENCH_MAX_ITERATIONS 20000
+
+static int compare_samples(const void* a, const void* b)
+{
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+
+  return (x > y) - (x < y);
+}
+
+uint64_t bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t bench_percentile(uint64_t* samples, size_t count, double pct)
+{
+  size_t index = 0;
+
+  if (count == 0)
+    return 0;
+
+  qsort(samples, count, sizeof(uint64_t), compare_samples);
+
+  /* Nearest-rank method */
+  index = (size_t)(pct * count + 0.5);
+  if (index > 0)
+    index--;
+  if (index >= count)
+    index = count - 1;
+
+  return samples[index];
+}
+
+size_t bench_iterations(size_t size)
+{
+  size_t iterations = BENCH_VOLUME / (size ? size : 1);
+
+  if (iterations < BENCH_MIN_ITERATIONS)
+    return BENCH_MIN_ITERATIONS;
+  else if (iterations > BENCH_MAX_ITERATIONS)
+    return BENCH_MAX_ITERATIONS;
+  else
+    return iterations;
+}
+
+char* bench_text(size_t size)
+{
+  static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 \n";
+  char* text = malloc(size + 1);
+  size_t i;
+
+  if (!text) {
+    perror("bench_text");
+    exit(1);
+  }
+
+  for(i=0; i < size; i++)
+    text[i] = alphabet[(i * 7 + i / 13) % (sizeof(alphabet) - 1)];
+  text[size] = '\0';
+
+  return text;
+}
+
+void bench_report(const char* suite, const char* scenario, size_t size, uint64_t* samples, size_t count, uint64_t wall_ns)
+{
+  uint64_t total = 0;
+  double seconds = 0;
+  size_t i;
+
+  for(i=0; i < count; i++)
+    total += samples[i];
+  seconds = (wall_ns ? wall_ns : total) / 1e9;
+
+  printf("{\"suite\":\"%s\",\"scenario\":\"%s\",\"size\":%lu,\"iterations\":%lu,"
+	 "\"mean_ns\":%.0f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,"
+	 "\"ops_per_s\":%.1f,\"mb_per_s\":%.2f}\n",
+	 suite, scenario,
+	 (unsigned long)size, (unsigned long)count,
+	 count ? (double)total / count : 0.0,
+	 (unsigned long long)bench_percentile(samples, count, 0.50),
+	 (unsigned long long)bench_percentile(samples, count, 0.99),
+	 (unsigned long long)bench_percentile(samples, count, 0.999),
+	 seconds > 0 ? count / seconds : 0.0,
+	 seconds > 0 ? (double)size * count / seconds / (1024.0 * 1024.0) : 0.0);
+  fflush(stdout);
+}
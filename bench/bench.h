@@ -0,0 +1,36 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#ifndef TINYCLIPBOARD_BENCH_H
+#define TINYCLIPBOARD_BENCH_H
+#include <stddef.h>
+#include <stdint.h>
+
+/* Monotonic timestamp in nanoseconds. */
+uint64_t bench_now(void);
+
+/* Returns `pct' (0 < pct <= 1) percentile of `count' samples,
+ * sorting `samples' in place. */
+uint64_t bench_percentile(uint64_t* samples, size_t count, double pct);
+
+/* Number of iterations to run for payloads of `size' bytes, so
+ * that every size moves roughly the same amount of data. */
+size_t bench_iterations(size_t size);
+
+/* Returns a newly allocated buffer of `size' bytes of printable
+ * ASCII text. */
+char* bench_text(size_t size);
+
+/* Prints one result line as a JSON object to stdout. `samples'
+ * holds the latencies of `count' operations in nanoseconds, each of
+ * which moved `size' bytes. `wall_ns' is the time all operations
+ * took together; pass 0 if they ran back to back, so that it is the
+ * sum of `samples'. `samples' is sorted by this function. */
+void bench_report(const char* suite, const char* scenario, size_t size, uint64_t* samples, size_t count, uint64_t wall_ns);
+
+#endif
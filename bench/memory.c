@@ -0,0 +1,125 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+/* Measures the library's own overhead by running the public API
+ * against the in-process memory backend. No graphics stack is
+ * involved, so the results are free of X server or window system
+ * noise. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "tinyclipboard.h"
+#include "bench.h"
+
+static const size_t s_sizes[] = {16, 256, 4096, 65536, 1048576, 16777216};
+
+static void bench_write(size_t size)
+{
+  char* text = bench_text(size);
+  size_t count = bench_iterations(size);
+  uint64_t* samples = calloc(count, sizeof(uint64_t));
+  size_t i;
+
+  for(i=0; i < count; i++) {
+    uint64_t start = bench_now();
+    if (tiny_clipnwrite(text, (int)size) < 0) {
+      perror("tiny_clipnwrite");
+      exit(1);
+    }
+    samples[i] = bench_now() - start;
+  }
+
+  bench_report("memory", "write", size, samples, count, 0);
+  free(samples);
+  free(text);
+}
+
+static void bench_read(size_t size)
+{
+  char* text = bench_text(size);
+  size_t count = bench_iterations(size);
+  uint64_t* samples = calloc(count, sizeof(uint64_t));
+  size_t i;
+
+  tiny_clipnwrite(text, (int)size);
+
+  for(i=0; i < count; i++) {
+    int len = 0;
+    uint64_t start = bench_now();
+    char* str = tiny_clipread(&len);
+    samples[i] = bench_now() - start;
+
+    if (!str || (size_t)len != size) {
+      fprintf(stderr, "tiny_clipread returned %d bytes, expected %lu\n", len, (unsigned long)size);
+      exit(1);
+    }
+    free(str);
+  }
+
+  bench_report("memory", "read", size, samples, count, 0);
+  free(samples);
+  free(text);
+}
+
+/* Writes with the history enabled, alternating between two texts, so
+ * that every write after the first two is a duplicate moved to the
+ * front of the history. */
+static void bench_write_history(size_t size)
+{
+  char* texts[2];
+  size_t count = bench_iterations(size);
+  uint64_t* samples = calloc(count, sizeof(uint64_t));
+  size_t i;
+
+  texts[0] = bench_text(size);
+  texts[1] = bench_text(size);
+  texts[1][0] ^= 1;
+
+  if (tiny_cliphistory(2 * size + 1) < 0) {
+    perror("tiny_cliphistory");
+    exit(1);
+  }
+
+  for(i=0; i < count; i++) {
+    uint64_t start = bench_now();
+    if (tiny_clipnwrite(texts[i % 2], (int)size) < 0) {
+      perror("tiny_clipnwrite");
+      exit(1);
+    }
+    samples[i] = bench_now() - start;
+  }
+
+  if (tiny_cliphistory_count() != 2) {
+    fprintf(stderr, "History holds %d entries, expected 2\n", tiny_cliphistory_count());
+    exit(1);
+  }
+
+  tiny_cliphistory(0);
+  bench_report("memory", "write_history", size, samples, count, 0);
+  free(samples);
+  free(texts[0]);
+  free(texts[1]);
+}
+
+int main()
+{
+  size_t i;
+
+  if (tiny_clipbackend("memory") < 0) {
+    perror("tiny_clipbackend");
+    return 1;
+  }
+
+  for(i=0; i < sizeof(s_sizes) / sizeof(s_sizes[0]); i++) {
+    bench_write(s_sizes[i]);
+    bench_read(s_sizes[i]);
+    bench_write_history(s_sizes[i]);
+  }
+
+  return 0;
+}
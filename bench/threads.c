@@ -0,0 +1,140 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+/* Stress test of the public API called from many threads at once.
+ * Writers fill the clipboard with a single repeated character each,
+ * so that readers can tell a torn text from a complete one. Pass the
+ * backend to use as the argument; the default is "memory". Run the
+ * "x11" backend through xvfb.sh. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "tinyclipboard.h"
+#include "bench.h"
+
+#define SIZE 4096          /* Payload of every operation */
+#define MEMORY_OPS 20000   /* Operations per thread with the memory backend */
+#define X11_OPS 200        /* Operations per thread with a real clipboard */
+
+static const int s_thread_counts[] = {1, 2, 4, 8, 16};
+static size_t s_ops = MEMORY_OPS;
+
+struct worker {
+  pthread_t thread;
+  int writer;
+  char fill;
+  uint64_t* samples;
+};
+
+static void* run_worker(void* arg)
+{
+  struct worker* p_worker = (struct worker*) arg;
+  char* text = malloc(SIZE);
+  size_t i;
+
+  memset(text, p_worker->fill, SIZE);
+
+  for(i=0; i < s_ops; i++) {
+    uint64_t start = bench_now();
+
+    if (p_worker->writer) {
+      if (tiny_clipnwrite(text, SIZE) < 0) {
+	perror("tiny_clipnwrite");
+	exit(1);
+      }
+      p_worker->samples[i] = bench_now() - start;
+    }
+    else {
+      int len = 0;
+      char* str = tiny_clipread(&len);
+      p_worker->samples[i] = bench_now() - start;
+
+      if (!str || len != SIZE || memchr(str, str[0] == 'a' ? 'b' : 'a', SIZE) || str[0] != str[SIZE - 1]) {
+	fprintf(stderr, "tiny_clipread returned a torn or wrong text of %d bytes\n", len);
+	exit(1);
+      }
+      free(str);
+    }
+  }
+
+  free(text);
+  return NULL;
+}
+
+/* Runs `readers' reading and `writers' writing threads at the same
+ * time and reports the latencies of all their operations. */
+static void bench_threads(const char* scenario, int readers, int writers)
+{
+  int count = readers + writers;
+  struct worker* workers = calloc(count, sizeof(struct worker));
+  uint64_t* samples = calloc(count * s_ops, sizeof(uint64_t));
+  char name[64];
+  uint64_t start = 0;
+  int i;
+
+  for(i=0; i < count; i++) {
+    workers[i].writer = i < writers;
+    workers[i].fill = i % 2 ? 'b' : 'a';
+    workers[i].samples = &samples[i * s_ops];
+  }
+
+  start = bench_now();
+  for(i=0; i < count; i++) {
+    if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+  for(i=0; i < count; i++)
+    pthread_join(workers[i].thread, NULL);
+
+  sprintf(name, "%s_%dthreads", scenario, count);
+  bench_report("threads", name, SIZE, samples, count * s_ops, bench_now() - start);
+
+  free(samples);
+  free(workers);
+}
+
+int main(int argc, char* argv[])
+{
+  const char* backend = argc > 1 ? argv[1] : "memory";
+  char* text = malloc(SIZE);
+  size_t i;
+
+  if (tiny_clipinit() < 0) {
+    perror("tiny_clipinit");
+    return 1;
+  }
+  if (tiny_clipbackend(backend) < 0) {
+    perror("tiny_clipbackend");
+    return 1;
+  }
+  if (strcmp(backend, "memory") != 0)
+    s_ops = X11_OPS;
+
+  /* Readers need something to read */
+  memset(text, 'a', SIZE);
+  if (tiny_clipnwrite(text, SIZE) < 0) {
+    perror("tiny_clipnwrite");
+    return 1;
+  }
+  free(text);
+
+  for(i=0; i < sizeof(s_thread_counts) / sizeof(s_thread_counts[0]); i++) {
+    int n = s_thread_counts[i];
+
+    bench_threads("read", n, 0);
+    bench_threads("write", 0, n);
+    if (n > 1)
+      bench_threads("mixed", n / 2, n - n / 2);
+  }
+
+  return 0;
+}
@@ -0,0 +1,1179 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+/* Latency benchmarks against a real X server. Run this through
+ * xvfb.sh (or `make bench') so that it gets a private Xvfb and does
+ * neither disturb nor get disturbed by a desktop session. Pass
+ * scenario names as arguments to run only these; the default is to
+ * run all of them.
+ *
+ * Processes forked here must leave with _exit(), because exit() would
+ * run the library's atexit() handler, which terminates the clipboard
+ * owner process shared with the parent. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include "tinyclipboard.h"
+#include "bench.h"
+
+#define MAX_ITERATIONS 2000     /* X requests are slow, keep runs short */
+#define BUSY_READERS 4          /* Background readers in the "read_busy_owner" scenario */
+#define BUSY_SIZE 65536         /* Payload they keep fetching */
+#define CONCURRENT_READERS 16   /* Processes in the "read_concurrent" scenario */
+#define CONCURRENT_READS 200    /* Reads each of them does */
+#define STRESS_PASTERS 64       /* Processes in the "stress_pasters" scenario */
+#define STRESS_READS 8          /* Reads each of them does */
+#define STRESS_SIZE 1048576     /* Payload they fetch; large enough for INCR */
+#define PREFETCH_MAX_SIZE 16777216 /* Prefetch everything in the "read_prefetched" scenario */
+#define COMPRESS_THRESHOLD 4096 /* Owner-side compression in the "read_compressed" scenario */
+#define OWNER_PROGRAM "./tinyclipboard-owner" /* See tiny_clipowner(); run from the top directory */
+#define RESPAWNS 20             /* Owner processes started per case in the "owner_spawn" scenario */
+#define BATCH_SIZE 4096         /* Payload of every entry in the "write_batch" scenario */
+
+static const size_t s_sizes[] = {16, 256, 4096, 65536, 1048576, 16777216};
+static const size_t s_compress_sizes[] = {65536, 1048576, 16777216};
+static const size_t s_ballast_sizes[] = {0, 268435456};
+
+/* Source code the "read_compressed" scenario copies, run from the top
+ * directory. Together more than the 64 KiB an LZ4 match reaches back,
+ * so that repeating them does not compress better than real code. */
+static const char* s_source_files[] = {"src/owner.c", "src/x11.c", "src/history.c", "src/tinyclipboard.c", NULL};
+
+static size_t iterations(size_t size)
+{
+  size_t count = bench_iterations(size);
+  return count > MAX_ITERATIONS ? MAX_ITERATIONS : count;
+}
+
+static void write_or_die(const char* text, size_t size)
+{
+  if (tiny_clipnwrite(text, (int)size) < 0) {
+    perror("tiny_clipnwrite");
+    exit(1);
+  }
+}
+
+/* Reads the clipboard and checks that it has the expected size.
+ * Returns 0 on success so forked readers can decide how to exit. */
+static int read_and_check(size_t size)
+{
+  int len = 0;
+  char* str = tiny_clipread(&len);
+
+  if (!str) {
+    perror("tiny_clipread");
+    return -1;
+  }
+  free(str);
+
+  if ((size_t)len != size) {
+    fprintf(stderr, "tiny_clipread returned %d bytes, expected %lu\n", len, (unsigned long)size);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Waits until the owner process serves text of `size' bytes, since
+ * ownership is taken asynchronously after a write. */
+static void settle(size_t size)
+{
+  int i;
+
+  for(i=0; i < 500; i++) {
+    int len = 0;
+    char* str = tiny_clipread(&len);
+    free(str);
+
+    if (str && (size_t)len == size)
+      return;
+
+    usleep(10000);
+  }
+
+  fprintf(stderr, "Clipboard never settled on %lu bytes\n", (unsigned long)size);
+  exit(1);
+}
+
+/* Returns a newly allocated buffer of `size' bytes of log lines. */
+static char* log_text(size_t size)
+{
+  static const char* levels[] = {"INFO", "DEBUG", "INFO", "WARN", "ERROR"};
+  char* text = malloc(size + 256);
+  size_t len = 0;
+  unsigned int i;
+
+  for(i=0; len < size; i++) {
+    len += sprintf(text + len, "2016-01-%02u %02u:%02u:%02u.%03u %-5s worker[%u]: processed request %u for /api/v1/items/%u in %u ms (status %u)\n",
+		   1 + i / 86400 % 28, i / 3600 % 24, i / 60 % 60, i % 60, i * 37 % 1000,
+		   levels[i % 5], i % 8, i * 7919 % 100000, i * 104729 % 5000, i * 31 % 250,
+		   i % 17 ? 200 : 500);
+  }
+
+  return text;
+}
+
+/* Returns a newly allocated buffer of `size' bytes of source code,
+ * going through s_source_files as often as needed. */
+static char* source_text(size_t size)
+{
+  char* text = malloc(size);
+  size_t len = 0;
+  int i;
+
+  for(i=0; len < size; i++) {
+    FILE* p_file = NULL;
+
+    if (!s_source_files[i])
+      i = 0;
+    if (!(p_file = fopen(s_source_files[i], "r"))) { /* Single = intended */
+      perror(s_source_files[i]);
+      exit(1);
+    }
+
+    len += fread(text + len, 1, size - len, p_file);
+    fclose(p_file);
+  }
+
+  return text;
+}
+
+/* Resident memory in KiB of the library's clipboard owner process,
+ * which is the only child process left when this is called. If
+ * `p_pid' is not NULL, it receives the process ID. */
+static long owner_rss(pid_t* p_pid)
+{
+  DIR* p_dir = opendir("/proc");
+  struct dirent* p_entry = NULL;
+  long rss = -1;
+
+  while (rss < 0 && p_dir && (p_entry = readdir(p_dir))) {
+    char path[300];
+    char line[256];
+    long ppid = -1;
+    FILE* p_file = NULL;
+
+    sprintf(path, "/proc/%.255s/status", p_entry->d_name);
+    if (!(p_file = fopen(path, "r"))) /* Single = intended */
+      continue;
+
+    while (fgets(line, sizeof(line), p_file)) {
+      if (strncmp(line, "PPid:", 5) == 0)
+	ppid = atol(line + 5);
+      else if (strncmp(line, "VmRSS:", 6) == 0 && ppid == getpid())
+	rss = atol(line + 6);
+    }
+    fclose(p_file);
+
+    if (rss >= 0 && p_pid)
+      *p_pid = atol(p_entry->d_name);
+  }
+
+  if (p_dir)
+    closedir(p_dir);
+
+  return rss;
+}
+
+/* CPU time in milliseconds that process `pid' has used so far, user
+ * and system together, or -1 if it cannot be told. */
+static long process_cpu_ms(pid_t pid)
+{
+  char path[64];
+  unsigned long utime = 0;
+  unsigned long stime = 0;
+  FILE* p_file = NULL;
+  int fields = 0;
+
+  sprintf(path, "/proc/%ld/stat", (long) pid);
+  if (!(p_file = fopen(path, "r"))) /* Single = intended */
+    return -1;
+
+  /* Fields 14 and 15; the command name in field 2 ends with ") " */
+  fields = fscanf(p_file, "%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+  fclose(p_file);
+
+  if (fields != 2)
+    return -1;
+
+  return (long) ((utime + stime) * 1000 / sysconf(_SC_CLK_TCK));
+}
+
+/* Kills the owner process and waits until it is gone, but leaves
+ * reaping it to the library, which starts a new one on the next
+ * write. */
+static void kill_owner(void)
+{
+  siginfo_t info;
+  pid_t pid = 0;
+
+  if (owner_rss(&pid) < 0) {
+    fprintf(stderr, "There is no owner process to kill\n");
+    exit(1);
+  }
+
+  kill(pid, SIGKILL);
+  waitid(P_PID, pid, &info, WEXITED | WNOWAIT);
+}
+
+/* Waits until the owner process has compressed the text written after
+ * `before' compressions; see tiny_clipstats(). */
+static void await_compression(unsigned long before)
+{
+  int i;
+
+  for(i=0; i < 100000; i++) {
+    struct tiny_clipstats stats;
+    tiny_clipstats(&stats);
+
+    if (stats.compressions > before)
+      return;
+
+    usleep(100);
+  }
+
+  fprintf(stderr, "Owner process never compressed the text\n");
+  exit(1);
+}
+
+/****************************************
+ * Scenarios
+ ***************************************/
+
+/* Latency of tiny_clipread() by payload size. */
+static void bench_read(void)
+{
+  size_t i;
+
+  for(i=0; i < sizeof(s_sizes) / sizeof(s_sizes[0]); i++) {
+    size_t size = s_sizes[i];
+    size_t count = iterations(size);
+    char* text = bench_text(size);
+    uint64_t* samples = calloc(count, sizeof(uint64_t));
+    size_t j;
+
+    write_or_die(text, size);
+    settle(size);
+
+    for(j=0; j < count; j++) {
+      uint64_t start = bench_now();
+      if (read_and_check(size) < 0)
+	exit(1);
+      samples[j] = bench_now() - start;
+    }
+
+    bench_report("x11", "read", size, samples, count, 0);
+    free(samples);
+    free(text);
+  }
+}
+
+/* Latency (and thus rate) of tiny_clipnwrite() by payload size. */
+static void bench_write(void)
+{
+  size_t i;
+
+  for(i=0; i < sizeof(s_sizes) / sizeof(s_sizes[0]); i++) {
+    size_t size = s_sizes[i];
+    size_t count = iterations(size);
+    char* text = bench_text(size);
+    uint64_t* samples = calloc(count, sizeof(uint64_t));
+    size_t j;
+
+    for(j=0; j < count; j++) {
+      uint64_t start = bench_now();
+      write_or_die(text, size);
+      samples[j] = bench_now() - start;
+    }
+
+    /* All those writes must not leave anything stale behind */
+    settle(size);
+
+    bench_report("x11", "write", size, samples, count, 0);
+    free(samples);
+    free(text);
+  }
+}
+
+/* Latency of a paste while other clients keep the owner busy with
+ * large transfers. */
+static void bench_read_busy_owner(void)
+{
+  char* text = bench_text(BUSY_SIZE);
+  size_t count = iterations(BUSY_SIZE);
+  uint64_t* samples = calloc(count, sizeof(uint64_t));
+  pid_t readers[BUSY_READERS];
+  size_t i;
+
+  write_or_die(text, BUSY_SIZE);
+  settle(BUSY_SIZE);
+
+  for(i=0; i < BUSY_READERS; i++) {
+    if ((readers[i] = fork()) == 0) { /* Single = intended */
+      for(;;) {
+	if (read_and_check(BUSY_SIZE) < 0)
+	  _exit(1);
+      }
+    }
+  }
+
+  for(i=0; i < count; i++) {
+    uint64_t start = bench_now();
+    if (read_and_check(BUSY_SIZE) < 0)
+      exit(1);
+    samples[i] = bench_now() - start;
+  }
+
+  for(i=0; i < BUSY_READERS; i++) {
+    kill(readers[i], SIGKILL);
+    waitpid(readers[i], NULL, 0);
+  }
+
+  bench_report("x11", "read_busy_owner", BUSY_SIZE, samples, count, 0);
+  free(samples);
+  free(text);
+}
+
+/* Many processes reading from one owner at the same time. Reports
+ * the latency distribution over all reads and the aggregate rate. */
+static void bench_read_concurrent(void)
+{
+  const size_t size = 4096;
+  const size_t count = CONCURRENT_READERS * CONCURRENT_READS;
+  char* text = bench_text(size);
+  uint64_t* samples = calloc(count, sizeof(uint64_t));
+  int pipefds[2];
+  uint64_t start = 0;
+  size_t i;
+
+  write_or_die(text, size);
+  settle(size);
+
+  if (pipe(pipefds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+
+  start = bench_now();
+  for(i=0; i < CONCURRENT_READERS; i++) {
+    if (fork() == 0) {
+      uint64_t mysamples[CONCURRENT_READS];
+      size_t j;
+
+      close(pipefds[0]);
+      for(j=0; j < CONCURRENT_READS; j++) {
+	uint64_t t = bench_now();
+	if (read_and_check(size) < 0)
+	  _exit(1);
+	mysamples[j] = bench_now() - t;
+      }
+
+      /* Below PIPE_BUF, so results of different readers do not interleave */
+      write(pipefds[1], mysamples, sizeof(mysamples));
+      _exit(0);
+    }
+  }
+  close(pipefds[1]);
+
+  for(i=0; i < CONCURRENT_READERS; i++) {
+    int status = 0;
+    wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "A concurrent reader failed\n");
+      exit(1);
+    }
+  }
+
+  for(i=0; i < count; i++) {
+    if (read(pipefds[0], &samples[i], sizeof(uint64_t)) != sizeof(uint64_t)) {
+      fprintf(stderr, "Lost concurrent reader results\n");
+      exit(1);
+    }
+  }
+  close(pipefds[0]);
+
+  bench_report("x11", "read_concurrent", size, samples, count, bench_now() - start);
+  free(samples);
+  free(text);
+}
+
+/* Many processes pasting a large text at the very same moment, which
+ * makes the owner serve them all with interleaved INCR transfers.
+ * Reports the latency distribution and aggregate rate, and how evenly
+ * the owner distributed its throughput over the pasters as Jain's
+ * fairness index (1.0 is perfectly fair, 1/n is maximally unfair).
+ * The CPU time the owner spent serving them is reported as well; on a
+ * loaded machine it varies far less between runs than the latencies,
+ * so it is what tells two builds of the owner apart. */
+static void bench_stress_pasters(void)
+{
+  const size_t count = STRESS_PASTERS * STRESS_READS;
+  char* text = bench_text(STRESS_SIZE);
+  uint64_t* samples = calloc(count, sizeof(uint64_t));
+  double rates[STRESS_PASTERS];
+  double sum = 0;
+  double sumsq = 0;
+  int resultfds[2];
+  int gofds[2];
+  uint64_t start = 0;
+  pid_t owner = 0;
+  long owner_cpu = -1;
+  size_t i;
+
+  write_or_die(text, STRESS_SIZE);
+  settle(STRESS_SIZE);
+
+  if (owner_rss(&owner) >= 0)
+    owner_cpu = process_cpu_ms(owner);
+
+  if (pipe(resultfds) < 0 || pipe(gofds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+
+  for(i=0; i < STRESS_PASTERS; i++) {
+    if (fork() == 0) {
+      uint64_t mysamples[STRESS_READS + 1]; /* Last one is the total */
+      uint64_t mystart = 0;
+      char go = 0;
+      size_t j;
+
+      close(resultfds[0]);
+      close(gofds[1]);
+
+      /* Wait until all pasters are ready; closing the pipe releases them */
+      read(gofds[0], &go, 1);
+
+      mystart = bench_now();
+      for(j=0; j < STRESS_READS; j++) {
+	uint64_t t = bench_now();
+	if (read_and_check(STRESS_SIZE) < 0)
+	  _exit(1);
+	mysamples[j] = bench_now() - t;
+      }
+      mysamples[STRESS_READS] = bench_now() - mystart;
+
+      write(resultfds[1], mysamples, sizeof(mysamples));
+      _exit(0);
+    }
+  }
+  close(resultfds[1]);
+  close(gofds[0]);
+
+  start = bench_now();
+  close(gofds[1]);
+
+  for(i=0; i < STRESS_PASTERS; i++) {
+    int status = 0;
+    wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "A paster failed\n");
+      exit(1);
+    }
+  }
+
+  for(i=0; i < STRESS_PASTERS; i++) {
+    uint64_t results[STRESS_READS + 1];
+
+    if (read(resultfds[0], results, sizeof(results)) != sizeof(results)) {
+      fprintf(stderr, "Lost paster results\n");
+      exit(1);
+    }
+
+    memcpy(&samples[i * STRESS_READS], results, STRESS_READS * sizeof(uint64_t));
+    rates[i] = (double)STRESS_SIZE * STRESS_READS / (results[STRESS_READS] / 1e9);
+    sum += rates[i];
+    sumsq += rates[i] * rates[i];
+  }
+  close(resultfds[0]);
+
+  if (owner_cpu >= 0 && process_cpu_ms(owner) >= 0)
+    owner_cpu = process_cpu_ms(owner) - owner_cpu;
+  else
+    owner_cpu = -1;
+
+  bench_report("x11", "stress_pasters", STRESS_SIZE, samples, count, bench_now() - start);
+  printf("{\"suite\":\"x11\",\"scenario\":\"stress_pasters_fairness\",\"size\":%d,\"pasters\":%d,\"jain_index\":%.4f,\"owner_cpu_ms\":%ld}\n",
+	 STRESS_SIZE, STRESS_PASTERS, sum * sum / (STRESS_PASTERS * sumsq), owner_cpu);
+  fflush(stdout);
+
+  free(samples);
+  free(text);
+}
+
+/* Latency of tiny_clipread() and tiny_clipborrow() with the prefetch
+ * thread running, so that neither needs to ask the owner process.
+ * Without XFixes, tiny_clipread() asks the owner all the same; see
+ * tiny_clipprefetch(3). */
+static void bench_read_prefetched(void)
+{
+  size_t i;
+
+  /* With the prefetch thread running, the owner process can no longer
+   * be forked */
+  if (tiny_clipowner(OWNER_PROGRAM) < 0) {
+    perror("tiny_clipowner(" OWNER_PROGRAM ")");
+    exit(1);
+  }
+  if (tiny_clipprefetch(PREFETCH_MAX_SIZE) < 0) {
+    perror("tiny_clipprefetch");
+    exit(1);
+  }
+
+  for(i=0; i < sizeof(s_sizes) / sizeof(s_sizes[0]); i++) {
+    size_t size = s_sizes[i];
+    size_t count = iterations(size);
+    char* text = bench_text(size);
+    uint64_t* samples = calloc(count, sizeof(uint64_t));
+    size_t j;
+
+    write_or_die(text, size);
+    settle(size);
+
+    for(j=0; j < count; j++) {
+      uint64_t start = bench_now();
+      if (read_and_check(size) < 0)
+	exit(1);
+      samples[j] = bench_now() - start;
+    }
+    bench_report("x11", "read_prefetched", size, samples, count, 0);
+
+    for(j=0; j < count; j++) {
+      int len = 0;
+      uint64_t start = bench_now();
+      const char* str = tiny_clipborrow(&len, NULL);
+      samples[j] = bench_now() - start;
+
+      if (!str || (size_t)len != size) {
+	fprintf(stderr, "tiny_clipborrow returned %d bytes, expected %lu\n", len, (unsigned long)size);
+	exit(1);
+      }
+      tiny_cliprelease(str);
+    }
+    bench_report("x11", "borrow_prefetched", size, samples, count, 0);
+
+    free(samples);
+    free(text);
+  }
+
+  tiny_clipprefetch(0);
+  tiny_clipowner(NULL);
+}
+
+/* Latency of tiny_clipread() with the owner process keeping the text
+ * plain ("read_plain_*") and compressed ("read_compressed_*"), which
+ * it expands for every request, for log lines and source code. Also
+ * reports the owner's resident memory in either case. */
+static void bench_read_compressed(void)
+{
+  static const char* kinds[] = {"log", "source"};
+  size_t i;
+  int kind;
+
+  for(kind=0; kind < 2; kind++) {
+    for(i=0; i < sizeof(s_compress_sizes) / sizeof(s_compress_sizes[0]); i++) {
+      size_t size = s_compress_sizes[i];
+      size_t count = iterations(size);
+      char* text = kind == 0 ? log_text(size) : source_text(size);
+      uint64_t* samples = calloc(count, sizeof(uint64_t));
+      long rss[3];
+      int compressed;
+
+      for(compressed=0; compressed < 2; compressed++) {
+	struct tiny_clipstats stats;
+	char name[64];
+	size_t j;
+
+	tiny_clipcompress(compressed ? COMPRESS_THRESHOLD : 0);
+	tiny_clipstats(&stats);
+	write_or_die(text, size);
+	settle(size);
+	if (compressed)
+	  await_compression(stats.compressions);
+	rss[compressed] = owner_rss(NULL);
+
+	for(j=0; j < count; j++) {
+	  uint64_t start = bench_now();
+	  if (read_and_check(size) < 0)
+	    exit(1);
+	  samples[j] = bench_now() - start;
+	}
+
+	/* Only the first paste of a compressed text expands it; the
+	 * others get the copy kept while pasting goes on. */
+	if (compressed) {
+	  rss[2] = owner_rss(NULL);
+	  sprintf(name, "read_compressed_first_%s", kinds[kind]);
+	  bench_report("x11", name, size, samples, 1, 0);
+	  sprintf(name, "read_compressed_%s", kinds[kind]);
+	  bench_report("x11", name, size, samples + 1, count - 1, 0);
+	}
+	else {
+	  sprintf(name, "read_plain_%s", kinds[kind]);
+	  bench_report("x11", name, size, samples, count, 0);
+	}
+      }
+
+      printf("{\"suite\":\"x11\",\"scenario\":\"compressed_owner_rss_%s\",\"size\":%lu,\"plain_kib\":%ld,\"compressed_kib\":%ld,\"pasting_kib\":%ld}\n",
+	     kinds[kind], (unsigned long)size, rss[0], rss[1], rss[2]);
+      fflush(stdout);
+
+      free(samples);
+      free(text);
+    }
+  }
+
+  tiny_clipcompress(0);
+}
+
+/* Cost of starting the owner process, forked or spawned (see
+ * tiny_clipowner()), while the parent holds a ballast of memory. A
+ * fork copies the page tables of the ballast, and the forked owner
+ * counts all of it as resident, even though it shares it with the
+ * parent until one of them writes to it. */
+static void bench_owner_spawn(void)
+{
+  static const char* modes[] = {"fork", "spawn"};
+  uint64_t samples[RESPAWNS];
+  size_t i;
+  int mode;
+
+  for(i=0; i < sizeof(s_ballast_sizes) / sizeof(s_ballast_sizes[0]); i++) {
+    size_t size = s_ballast_sizes[i];
+    char* ballast = malloc(size ? size : 1);
+    long rss[2];
+
+    memset(ballast, 'b', size); /* Make it resident */
+
+    for(mode=0; mode < 2; mode++) {
+      char name[64];
+      size_t j;
+
+      if (tiny_clipowner(mode ? OWNER_PROGRAM : NULL) < 0) {
+	perror("tiny_clipowner(" OWNER_PROGRAM ")");
+	exit(1);
+      }
+
+      /* Make sure there is an owner of the current kind to kill */
+      write_or_die("ballast", 7);
+      for(j=0; j < RESPAWNS; j++) {
+	uint64_t start = 0;
+
+	kill_owner();
+	start = bench_now();
+	write_or_die("ballast", 7);
+	samples[j] = bench_now() - start;
+      }
+      rss[mode] = owner_rss(NULL);
+
+      sprintf(name, "respawn_%s_%luMiB", modes[mode], (unsigned long)(size >> 20));
+      bench_report("x11", name, 7, samples, RESPAWNS, 0);
+    }
+
+    printf("{\"suite\":\"x11\",\"scenario\":\"owner_rss\",\"ballast_mib\":%lu,\"fork_kib\":%ld,\"spawn_kib\":%ld}\n",
+	   (unsigned long)(size >> 20), rss[0], rss[1]);
+    fflush(stdout);
+
+    free(ballast);
+  }
+
+  tiny_clipowner(NULL);
+}
+
+/****************************************
+ * Clipboard manager
+ ***************************************/
+
+#define MANAGER_MAX_SIZE 1048576 /* It serves without INCR, keep below the request size limit */
+
+static Bool is_selection_notify(Display* p_display, XEvent* p_evt, XPointer arg)
+{
+  return p_evt->type == SelectionNotify;
+}
+
+static Bool is_new_property(Display* p_display, XEvent* p_evt, XPointer arg)
+{
+  return p_evt->type == PropertyNotify && p_evt->xproperty.state == PropertyNewValue;
+}
+
+/* Fetches and deletes `property' of `window', appending its content
+ * to `*p_buf'. Returns the number of bytes appended. */
+static unsigned long fetch_property(Display* p_display, Window window, Atom property, Atom* p_type, char** p_buf, unsigned long* p_len)
+{
+  unsigned char* p_data = NULL;
+  unsigned long nitems = 0;
+  unsigned long bytes_left = 0;
+  int format = 0;
+
+  XGetWindowProperty(p_display, window, property, 0, 0x1000000, True,
+		     AnyPropertyType, p_type, &format, &nitems, &bytes_left, &p_data);
+
+  if (format == 8 && nitems > 0) {
+    *p_buf = realloc(*p_buf, *p_len + nitems);
+    memcpy(*p_buf + *p_len, p_data, nitems);
+    *p_len += nitems;
+  }
+  else {
+    nitems = 0;
+  }
+
+  XFree(p_data);
+  return nitems;
+}
+
+/* A minimal freedesktop.org clipboard manager: on SAVE_TARGETS it
+ * copies the UTF-8 text of the current CLIPBOARD owner, takes over
+ * CLIPBOARD and serves the copy from then on. Signals readiness on
+ * `readyfd' and never returns. */
+static void run_clipboard_manager(int readyfd)
+{
+  Display* p_display = XOpenDisplay(NULL);
+  Window window = None;
+  Atom clipboard, manager, save_targets, targets, utf8, store_prop, incr;
+  char* saved = NULL;
+  unsigned long savedlen = 0;
+
+  if (!p_display)
+    _exit(1);
+
+  window = XCreateSimpleWindow(p_display, XDefaultRootWindow(p_display), 0, 0, 1, 1, 0, 0, 0);
+  clipboard = XInternAtom(p_display, "CLIPBOARD", False);
+  manager = XInternAtom(p_display, "CLIPBOARD_MANAGER", False);
+  save_targets = XInternAtom(p_display, "SAVE_TARGETS", False);
+  targets = XInternAtom(p_display, "TARGETS", False);
+  utf8 = XInternAtom(p_display, "UTF8_STRING", False);
+  store_prop = XInternAtom(p_display, "BENCH_MANAGER_STORE", False);
+  incr = XInternAtom(p_display, "INCR", False);
+
+  XSelectInput(p_display, window, PropertyChangeMask);
+  XSetSelectionOwner(p_display, manager, window, CurrentTime);
+  XSync(p_display, False);
+  write(readyfd, "r", 1);
+  close(readyfd);
+
+  for(;;) {
+    XEvent evt;
+    XEvent reply;
+    XSelectionRequestEvent* p_req = &evt.xselectionrequest;
+
+    XNextEvent(p_display, &evt);
+    if (evt.type != SelectionRequest)
+      continue;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.xselection.type = SelectionNotify;
+    reply.xselection.requestor = p_req->requestor;
+    reply.xselection.selection = p_req->selection;
+    reply.xselection.target = p_req->target;
+    reply.xselection.time = p_req->time;
+    reply.xselection.property = None;
+
+    if (p_req->selection == manager && p_req->target == save_targets) {
+      XEvent notify;
+      XSelectionRequestEvent request = *p_req; /* `evt' is reused below */
+
+      XConvertSelection(p_display, clipboard, utf8, store_prop, window, CurrentTime);
+      XIfEvent(p_display, &notify, is_selection_notify, NULL);
+
+      if (notify.xselection.property != None) {
+	Atom type = None;
+	XEvent stale;
+
+	while (XCheckIfEvent(p_display, &stale, is_new_property, NULL))
+	  ;
+
+	savedlen = 0;
+	fetch_property(p_display, window, store_prop, &type, &saved, &savedlen);
+	if (type == incr) {
+	  /* Collect chunks until the empty one arrives */
+	  do {
+	    XIfEvent(p_display, &stale, is_new_property, NULL);
+	  } while (fetch_property(p_display, window, store_prop, &type, &saved, &savedlen) > 0);
+	}
+
+	XSetSelectionOwner(p_display, clipboard, window, CurrentTime);
+	reply.xselection.property = request.property;
+      }
+
+      reply.xselection.requestor = request.requestor;
+      XSendEvent(p_display, request.requestor, False, NoEventMask, &reply);
+      XFlush(p_display);
+      continue;
+    }
+    else if (p_req->selection == clipboard && p_req->target == targets) {
+      Atom supported[] = {targets, utf8};
+      XChangeProperty(p_display, p_req->requestor, p_req->property, XA_ATOM, 32,
+		      PropModeReplace, (unsigned char*)supported, 2);
+      reply.xselection.property = p_req->property;
+    }
+    else if (p_req->selection == clipboard && p_req->target == utf8 && saved) {
+      XChangeProperty(p_display, p_req->requestor, p_req->property, utf8, 8,
+		      PropModeReplace, (unsigned char*)saved, savedlen);
+      reply.xselection.property = p_req->property;
+    }
+
+    XSendEvent(p_display, p_req->requestor, False, NoEventMask, &reply);
+    XFlush(p_display);
+  }
+}
+
+/* Waits until the owner process has finished the handoff following
+ * the write that left `before' handoffs behind; see tiny_clipstats(). */
+static void await_handoff(unsigned long before)
+{
+  int i;
+
+  for(i=0; i < 100000; i++) {
+    struct tiny_clipstats stats;
+    tiny_clipstats(&stats);
+
+    if (stats.manager_handoffs + stats.manager_failures > before)
+      return;
+
+    usleep(100);
+  }
+
+  fprintf(stderr, "Clipboard manager handoff never finished\n");
+  exit(1);
+}
+
+/* Time tiny_clipnwrite() blocks while a clipboard manager is running
+ * ("manager_handoff"), and the time until the manager has taken the
+ * text over in the background ("manager_handoff_complete"). */
+static void bench_manager_handoff(void)
+{
+  int readyfds[2];
+  pid_t manager = 0;
+  char ready = 0;
+  size_t i;
+
+  if (pipe(readyfds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+
+  if ((manager = fork()) == 0) { /* Single = intended */
+    close(readyfds[0]);
+    run_clipboard_manager(readyfds[1]);
+    _exit(0);
+  }
+  close(readyfds[1]);
+
+  if (read(readyfds[0], &ready, 1) != 1) {
+    fprintf(stderr, "Clipboard manager failed to start\n");
+    exit(1);
+  }
+  close(readyfds[0]);
+
+  for(i=0; i < sizeof(s_sizes) / sizeof(s_sizes[0]); i++) {
+    size_t size = s_sizes[i];
+    size_t count = iterations(size) / 4; /* Each handoff is a full transfer */
+    char* text = NULL;
+    uint64_t* samples = NULL;
+    uint64_t* complete = NULL;
+    size_t j;
+
+    if (size > MANAGER_MAX_SIZE)
+      break;
+
+    text = bench_text(size);
+    samples = calloc(count, sizeof(uint64_t));
+    complete = calloc(count, sizeof(uint64_t));
+
+    for(j=0; j < count; j++) {
+      struct tiny_clipstats stats;
+      uint64_t start = 0;
+
+      tiny_clipstats(&stats);
+      start = bench_now();
+      write_or_die(text, size);
+      samples[j] = bench_now() - start;
+      await_handoff(stats.manager_handoffs + stats.manager_failures);
+      complete[j] = bench_now() - start;
+    }
+
+    settle(size);
+
+    bench_report("x11", "manager_handoff", size, samples, count, 0);
+    bench_report("x11", "manager_handoff_complete", size, complete, count, 0);
+    free(complete);
+    free(samples);
+    free(text);
+  }
+
+  kill(manager, SIGKILL);
+  waitpid(manager, NULL, 0);
+}
+
+/* Converts `selection' to `target' like a pasting client would and
+ * checks that the result is the `len' bytes at `expected', or that
+ * the owner refuses if `expected' is NULL. */
+static void check_conversion(Display* p_display, Window window, Atom selection, const char* target, const char* expected, unsigned long len)
+{
+  Atom property = XInternAtom(p_display, "BENCH_BATCH", False);
+  Atom type = None;
+  char* buf = NULL;
+  unsigned long buflen = 0;
+  XEvent evt;
+
+  XConvertSelection(p_display, selection, XInternAtom(p_display, target, False), property, window, CurrentTime);
+  do {
+    XNextEvent(p_display, &evt);
+  } while (evt.type != SelectionNotify);
+
+  if (!expected) {
+    if (evt.xselection.property != None) {
+      fprintf(stderr, "%s still offers %s after it was replaced\n", XGetAtomName(p_display, selection), target);
+      exit(1);
+    }
+    return;
+  }
+
+  if (evt.xselection.property == None || !fetch_property(p_display, window, property, &type, &buf, &buflen)
+      || buflen != len || memcmp(buf, expected, len) != 0) {
+    fprintf(stderr, "Converting %s to %s did not return what was committed\n", XGetAtomName(p_display, selection), target);
+    exit(1);
+  }
+
+  free(buf);
+}
+
+/* Checks that the TARGETS of `selection' list `target' if `listed'
+ * is nonzero, and do not list it otherwise. */
+static void check_targets(Display* p_display, Window window, Atom selection, const char* target, int listed)
+{
+  Atom property = XInternAtom(p_display, "BENCH_BATCH", False);
+  Atom wanted = XInternAtom(p_display, target, False);
+  Atom type = None;
+  Atom* p_atoms = NULL;
+  unsigned long nitems = 0;
+  unsigned long bytes_left = 0;
+  unsigned long i;
+  int format = 0;
+  int found = 0;
+  XEvent evt;
+
+  XConvertSelection(p_display, selection, XInternAtom(p_display, "TARGETS", False), property, window, CurrentTime);
+  do {
+    XNextEvent(p_display, &evt);
+  } while (evt.type != SelectionNotify);
+
+  if (evt.xselection.property != None)
+    XGetWindowProperty(p_display, window, property, 0, 1024, True, XA_ATOM, &type, &format, &nitems, &bytes_left, (unsigned char**) &p_atoms);
+
+  for(i=0; format == 32 && i < nitems; i++) {
+    if (p_atoms[i] == wanted)
+      found = 1;
+  }
+  if (p_atoms)
+    XFree(p_atoms);
+
+  if (found != listed) {
+    fprintf(stderr, "The TARGETS of %s %s %s\n", XGetAtomName(p_display, selection), listed ? "lack" : "still list", target);
+    exit(1);
+  }
+}
+
+/* Returns what the owner of `selection' answers for TIMESTAMP, i.e.
+ * the server time it took the selection at, or 0 on refusal. */
+static unsigned long selection_timestamp(Display* p_display, Window window, Atom selection)
+{
+  Atom property = XInternAtom(p_display, "BENCH_BATCH", False);
+  Atom type = None;
+  unsigned char* p_data = NULL;
+  unsigned long nitems = 0;
+  unsigned long bytes_left = 0;
+  unsigned long timestamp = 0;
+  int format = 0;
+  XEvent evt;
+
+  XConvertSelection(p_display, selection, XInternAtom(p_display, "TIMESTAMP", False), property, window, CurrentTime);
+  do {
+    XNextEvent(p_display, &evt);
+  } while (evt.type != SelectionNotify);
+
+  if (evt.xselection.property != None)
+    XGetWindowProperty(p_display, window, property, 0, 1, True, AnyPropertyType, &type, &format, &nitems, &bytes_left, &p_data);
+
+  if (format == 32 && nitems == 1)
+    timestamp = *(unsigned long*) p_data;
+  if (p_data)
+    XFree(p_data);
+
+  return timestamp;
+}
+
+/* Commits `text' for CLIPBOARD as a batch, and if `html' is not NULL,
+ * also `html' for it and both for PRIMARY. Exits on failure. */
+static void commit_or_die(const char* text, const char* html)
+{
+  struct tiny_clipbatch* p_batch = tiny_clipbegin();
+
+  tiny_clipadd(p_batch, TINY_CLIPSELECTION_CLIPBOARD, NULL, text, BATCH_SIZE);
+  if (html) {
+    tiny_clipadd(p_batch, TINY_CLIPSELECTION_CLIPBOARD, "text/html", html, BATCH_SIZE);
+    tiny_clipadd(p_batch, TINY_CLIPSELECTION_PRIMARY, NULL, text, BATCH_SIZE);
+    tiny_clipadd(p_batch, TINY_CLIPSELECTION_PRIMARY, "text/html", html, BATCH_SIZE);
+  }
+  if (tiny_clipcommit(p_batch) < 0) {
+    perror("tiny_clipcommit");
+    exit(1);
+  }
+}
+
+/* Latency of a rich copy: text and HTML for CLIPBOARD and PRIMARY
+ * committed as one batch, against the same number of separate
+ * tiny_clipnwrite() calls and a batch of the text alone. Afterwards
+ * checks that each selection serves exactly what was committed for
+ * it, and that every commit renews its TIMESTAMP. */
+static void bench_write_batch(void)
+{
+  size_t count = iterations(BATCH_SIZE);
+  uint64_t* samples = calloc(count, sizeof(uint64_t));
+  char* text = malloc(BATCH_SIZE);
+  char* html = malloc(BATCH_SIZE);
+  Display* p_display = XOpenDisplay(NULL);
+  Window window = None;
+  Atom selections[2];
+  unsigned long stamps[2];
+  int kind;
+  size_t i;
+  int s;
+
+  if (!p_display) {
+    fprintf(stderr, "Cannot open the X display\n");
+    exit(1);
+  }
+  window = XCreateSimpleWindow(p_display, XDefaultRootWindow(p_display), 0, 0, 1, 1, 0, 0, 0);
+  selections[TINY_CLIPSELECTION_CLIPBOARD] = XInternAtom(p_display, "CLIPBOARD", False);
+  selections[TINY_CLIPSELECTION_PRIMARY] = XA_PRIMARY;
+
+  memset(text, 't', BATCH_SIZE);
+  memset(html, 'h', BATCH_SIZE);
+  memcpy(html, "<p>", 3);
+
+  for(kind=0; kind < 3; kind++) {
+    static const char* names[] = {"batch_text", "batch_rich", "nwrite_x4"};
+
+    for(i=0; i < count; i++) {
+      uint64_t start = bench_now();
+
+      if (kind < 2) {
+	commit_or_die(text, kind == 1 ? html : NULL);
+      }
+      else {
+	int j;
+
+	for(j=0; j < 4; j++)
+	  write_or_die(text, BATCH_SIZE);
+      }
+
+      samples[i] = bench_now() - start;
+    }
+
+    bench_report("x11", names[kind], BATCH_SIZE, samples, count, 0);
+
+    /* Every entry of the rich batch is served from its selection */
+    if (kind == 1) {
+      for(s=0; s < 2; s++) {
+	check_conversion(p_display, window, selections[s], "UTF8_STRING", text, BATCH_SIZE);
+	check_conversion(p_display, window, selections[s], "STRING", text, BATCH_SIZE);
+	check_conversion(p_display, window, selections[s], "text/html", html, BATCH_SIZE);
+	check_targets(p_display, window, selections[s], "text/html", 1);
+      }
+
+      /* Every commit takes both selections anew, so that TIMESTAMP
+       * tells pasting clients and XFixes listeners that the content
+       * changed. The pause keeps the two commits apart in server
+       * time, which counts milliseconds. */
+      for(s=0; s < 2; s++)
+	stamps[s] = selection_timestamp(p_display, window, selections[s]);
+      usleep(5000);
+      commit_or_die(text, html);
+      for(s=0; s < 2; s++) {
+	if (selection_timestamp(p_display, window, selections[s]) <= stamps[s]) {
+	  fprintf(stderr, "Committing did not renew the TIMESTAMP of %s\n", XGetAtomName(p_display, selections[s]));
+	  exit(1);
+	}
+      }
+    }
+  }
+
+  /* The writes of the text alone replaced CLIPBOARD only */
+  check_conversion(p_display, window, selections[TINY_CLIPSELECTION_CLIPBOARD], "UTF8_STRING", text, BATCH_SIZE);
+  check_conversion(p_display, window, selections[TINY_CLIPSELECTION_CLIPBOARD], "text/html", NULL, 0);
+  check_targets(p_display, window, selections[TINY_CLIPSELECTION_CLIPBOARD], "text/html", 0);
+  check_conversion(p_display, window, selections[TINY_CLIPSELECTION_PRIMARY], "text/html", html, BATCH_SIZE);
+  check_targets(p_display, window, selections[TINY_CLIPSELECTION_PRIMARY], "text/html", 1);
+
+  XDestroyWindow(p_display, window);
+  XCloseDisplay(p_display);
+  free(html);
+  free(text);
+  free(samples);
+}
+
+/****************************************
+ * Main
+ ***************************************/
+
+struct scenario {
+  const char* name;
+  void (*run)(void);
+};
+
+static const struct scenario s_scenarios[] = {
+  {"read", bench_read},
+  {"write", bench_write},
+  {"read_busy_owner", bench_read_busy_owner},
+  {"read_concurrent", bench_read_concurrent},
+  {"stress_pasters", bench_stress_pasters},
+  {"manager_handoff", bench_manager_handoff},
+  {"read_prefetched", bench_read_prefetched},
+  {"read_compressed", bench_read_compressed},
+  {"owner_spawn", bench_owner_spawn},
+  {"write_batch", bench_write_batch}
+};
+
+int main(int argc, char* argv[])
+{
+  size_t i;
+  int j;
+
+  /* read_prefetched runs the prefetch thread */
+  if (tiny_clipinit() < 0) {
+    perror("tiny_clipinit");
+    return 1;
+  }
+  if (tiny_clipbackend("x11") < 0) {
+    perror("tiny_clipbackend");
+    return 1;
+  }
+
+  for(i=0; i < sizeof(s_scenarios) / sizeof(s_scenarios[0]); i++) {
+    int selected = argc < 2;
+
+    for(j=1; j < argc; j++) {
+      if (strcmp(argv[j], s_scenarios[i].name) == 0)
+	selected = 1;
+    }
+
+    if (selected)
+      s_scenarios[i].run();
+  }
+
+  return 0;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+# tinyclipboard - a cross-platform C library for accessing the clipboard.
+#
+# Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+#
+# All rights reserved. See the README and LICENSE files for the
+# licensing conditions.
+#
+# Runs the given command with DISPLAY pointing to a private Xvfb
+# server, which is shut down again afterwards. Usage:
+#
+#   bench/xvfb.sh COMMAND [ARGS...]
+
+if ! command -v Xvfb > /dev/null 2>&1 ; then
+    echo "xvfb.sh: Xvfb not found; install it to run the X11 benchmarks." >&2
+    exit 1
+fi
+
+displayfile=`mktemp`
+Xvfb -displayfd 3 -nolisten tcp -screen 0 640x480x24 3> "$displayfile" 2> /dev/null &
+xvfbpid=$!
+trap 'kill $xvfbpid 2> /dev/null ; wait $xvfbpid 2> /dev/null ; rm -f "$displayfile"' EXIT INT TERM
+
+# Xvfb writes the display number it picked once it accepts connections.
+tries=0
+while [ ! -s "$displayfile" ] ; do
+    tries=`expr $tries + 1`
+    if [ $tries -gt 100 ] || ! kill -0 $xvfbpid 2> /dev/null ; then
+        echo "xvfb.sh: Xvfb failed to start." >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+DISPLAY=":`head -n 1 "$displayfile"`" "$@"
@@ -0,0 +1,32 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "tinyclipboard.h"
+
+int main()
+{
+  struct tiny_clipstats stats;
+  int len = 0;
+  char* str = tiny_clipread(&len);
+
+  if (str) {
+    printf("The clipboard contains %d bytes.\n", len);
+    free(str);
+  }
+  else {
+    printf("No text in clipboard or no clipboard owner.\n");
+  }
+
+  /* Counters are cumulative; this is all the process did so far */
+  tiny_clipstats(&stats);
+  printf("Reading took %lu X11 round trips and %lu bytes.\n", stats.x11_roundtrips, stats.bytes_read);
+
+  return 0;
+}
@@ -11,9 +11,87 @@
 #define TINYCLIPBOARD_VERSION 20160100L
 #define TINYCLIPBOARD_VERSION_POSTFIX ""
 
+#include <stddef.h>
+
+int tiny_clipinit(void);
 const char* tiny_clipversion();
 char* tiny_clipread(int* len);
 int tiny_clipwrite(const char* text);
 int tiny_clipnwrite(const char* text, int len);
+int tiny_clipbackend(const char* name);
+
+int tiny_cliphistory(size_t budget);
+int tiny_cliphistory_count(void);
+char* tiny_cliphistory_get(int index, int* len);
+int tiny_cliphistory_recall(int index);
+
+int tiny_clipprefetch(int maxlen);
+const char* tiny_clipborrow(int* len, unsigned long* p_generation);
+void tiny_cliprelease(const char* text);
+
+int tiny_clipcompress(int threshold);
+int tiny_clipowner(const char* path);
+
+enum tiny_clipselection {
+  TINY_CLIPSELECTION_CLIPBOARD,
+  TINY_CLIPSELECTION_PRIMARY     /* Marked text, pasted with the middle mouse button (X11) */
+};
+
+/* Batches write several targets and PRIMARY along with CLIPBOARD;
+ * see tiny_clipbegin(3). Only the x11 backend supports this. With
+ * the others, tiny_clipcommit() fails with ENOTSUP unless the batch
+ * holds nothing but the CLIPBOARD text (target NULL). */
+struct tiny_clipbatch;
+
+struct tiny_clipbatch* tiny_clipbegin(void);
+int tiny_clipadd(struct tiny_clipbatch* p_batch, enum tiny_clipselection selection, const char* target, const char* data, int len);
+int tiny_clipcommit(struct tiny_clipbatch* p_batch);
+void tiny_clipabort(struct tiny_clipbatch* p_batch);
+
+struct tiny_clipstats {
+  unsigned long x11_roundtrips;      /* Requests that waited for a reply from the X server */
+  unsigned long bytes_read;          /* Bytes returned by tiny_clipread() */
+  unsigned long bytes_written;       /* Bytes accepted by tiny_clipnwrite() */
+  unsigned long bytes_served;        /* Bytes sent to other clients requesting the clipboard */
+  unsigned long served_targets;      /* SelectionRequests served for TARGETS or TIMESTAMP */
+  unsigned long served_utf8;
+  unsigned long served_string;
+  unsigned long served_save_targets;
+  unsigned long served_other;        /* Unsupported targets or empty clipboard */
+  unsigned long owner_respawns;      /* Clipboard owner processes recreated after dying */
+  unsigned long coalesced_writes;    /* Texts replaced before anybody requested them */
+  unsigned long forks;               /* Clipboard owner processes created */
+  unsigned long incr_transfers;      /* Requests served in chunks because of their size */
+  unsigned long transfers_expired;   /* Chunked transfers dropped because the requestor stalled */
+  unsigned long manager_handoffs;    /* Texts taken over by a clipboard manager */
+  unsigned long manager_failures;    /* Clipboard manager refused or did not answer in time */
+  unsigned long history_duplicates;  /* Texts already in the history */
+  unsigned long history_evictions;   /* History entries dropped to stay within the budget */
+  unsigned long prefetch_fetches;    /* Texts fetched by the prefetch thread */
+  unsigned long prefetch_hits;       /* Reads answered with the prefetched text */
+  unsigned long compressions;        /* Texts the owner process keeps compressed */
+  unsigned long decompressions;      /* Compressed texts expanded again for pasting */
+  unsigned long bytes_saved;         /* Memory saved by compressing, summed over all texts */
+  unsigned long batch_commits;       /* Batches written with tiny_clipcommit() */
+  unsigned long served_added;        /* SelectionRequests served for targets added with tiny_clipadd() */
+};
+
+enum tiny_clipphase {
+  TINY_CLIPPHASE_READ_BEGIN,
+  TINY_CLIPPHASE_READ_REQUEST,   /* Conversion requested from the clipboard owner */
+  TINY_CLIPPHASE_READ_NOTIFY,    /* Clipboard owner answered */
+  TINY_CLIPPHASE_READ_END,
+  TINY_CLIPPHASE_WRITE_BEGIN,
+  TINY_CLIPPHASE_WRITE_MANAGER,  /* Clipboard manager took over or failed (owner process) */
+  TINY_CLIPPHASE_WRITE_OWNER,    /* Clipboard owner process owns the new text */
+  TINY_CLIPPHASE_WRITE_END,
+  TINY_CLIPPHASE_SERVE_BEGIN,    /* Request of another client received (owner process) */
+  TINY_CLIPPHASE_SERVE_END       /* Request of another client answered (owner process) */
+};
+
+typedef void (*tiny_cliptracefunc)(enum tiny_clipphase phase, unsigned long long timestamp, void* p_userdata);
+
+void tiny_clipstats(struct tiny_clipstats* p_stats);
+void tiny_cliptrace(tiny_cliptracefunc func, void* p_userdata);
 
 #endif
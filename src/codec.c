@@ -0,0 +1,192 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+/* Parameters of the LZ4 block format the owner process compresses
+ * texts with; see clip_compress_block(). */
+#define LZ_MINMATCH 4        /* Shortest match the format can express */
+#define LZ_LASTLITERALS 5    /* The last bytes are always literals */
+#define LZ_MFLIMIT 12        /* Matches must start this far before the end */
+#define LZ_MAXOFFSET 65535   /* Matches are at most this far back */
+#define LZ_HASHLOG 12        /* Size of the match finder's table */
+
+static bool append_block_sequence(char* dst, int* p_pos, int capacity, const char* literals, int litlen, int offset, int matchlen);
+
+/****************************************
+ * Compression
+ ***************************************/
+
+/* The owner process may hold a text for hours; it keeps large ones
+ * compressed in the LZ4 block format, which is simple and decompresses
+ * at memory speed. The output is a series of sequences, each made of
+ * a token byte whose high and low nibble give the number of literals
+ * and of matched bytes (minus LZ_MINMATCH), further length bytes if a
+ * nibble is 15, the literals, and the match's 16-bit little-endian
+ * offset back into the output. The last sequence has literals only. */
+
+/* Compresses `len' bytes at `src' into at most `capacity' bytes at
+ * `dst', finding matches greedily through a table of the positions
+ * where 4-byte sequences were last seen. Returns the compressed size,
+ * or 0 if it would exceed `capacity'. */
+int clip_compress_block(const char* src, int len, char* dst, int capacity)
+{
+  int table[1 << LZ_HASHLOG];
+  int anchor = 0; /* Start of the literals not yet written */
+  int pos = 0;
+  int out = 0;
+
+  memset(table, 0xff, sizeof(table)); /* All -1 */
+
+  while (pos < len - LZ_MFLIMIT) {
+    unsigned int seq = 0;
+    unsigned int hash = 0;
+    int candidate = 0;
+    int matchlen = LZ_MINMATCH;
+
+    memcpy(&seq, src + pos, 4);
+    hash = (seq * 2654435761U) >> (32 - LZ_HASHLOG);
+    candidate = table[hash];
+    table[hash] = pos;
+
+    if (candidate < 0 || pos - candidate > LZ_MAXOFFSET || memcmp(src + candidate, src + pos, 4) != 0) {
+      pos += 1 + ((pos - anchor) >> 6); /* Skip faster through incompressible data */
+      continue;
+    }
+
+    /* Extend the match in both directions */
+    while (pos > anchor && candidate > 0 && src[pos - 1] == src[candidate - 1]) {
+      pos--;
+      candidate--;
+      matchlen++;
+    }
+    while (pos + matchlen < len - LZ_LASTLITERALS && src[pos + matchlen] == src[candidate + matchlen])
+      matchlen++;
+
+    if (!append_block_sequence(dst, &out, capacity, src + anchor, pos - anchor, pos - candidate, matchlen))
+      return 0;
+
+    pos += matchlen;
+    anchor = pos;
+  }
+
+  if (!append_block_sequence(dst, &out, capacity, src + anchor, len - anchor, 0, 0))
+    return 0;
+
+  return out;
+}
+
+/* Appends a sequence of `litlen' literals and a match of `matchlen'
+ * bytes `offset' bytes back (none if `matchlen' is 0) to the `*p_pos'
+ * bytes at `dst'. Returns false if that would exceed `capacity'. */
+bool append_block_sequence(char* dst, int* p_pos, int capacity, const char* literals, int litlen, int offset, int matchlen)
+{
+  int pos = *p_pos;
+  int n = 0;
+
+  /* Generous bound for the token, lengths and offset */
+  if (capacity - pos < 1 + litlen + litlen / 255 + 1 + 2 + matchlen / 255 + 1)
+    return false;
+
+  dst[pos++] = (char)((litlen < 15 ? litlen : 15) << 4 | (matchlen == 0 ? 0 : matchlen - LZ_MINMATCH < 15 ? matchlen - LZ_MINMATCH : 15));
+
+  if (litlen >= 15) {
+    for(n = litlen - 15; n >= 255; n -= 255)
+      dst[pos++] = (char) 255;
+    dst[pos++] = (char) n;
+  }
+
+  memcpy(dst + pos, literals, litlen);
+  pos += litlen;
+
+  if (matchlen > 0) {
+    dst[pos++] = (char)(offset & 0xff);
+    dst[pos++] = (char)(offset >> 8);
+
+    if (matchlen - LZ_MINMATCH >= 15) {
+      for(n = matchlen - LZ_MINMATCH - 15; n >= 255; n -= 255)
+	dst[pos++] = (char) 255;
+      dst[pos++] = (char) n;
+    }
+  }
+
+  *p_pos = pos;
+  return true;
+}
+
+/* Decompresses the `srclen' bytes at `src' into at most `dstlen'
+ * bytes at `dst'. Returns the decompressed size, or -1 if the input
+ * is malformed or does not fit. */
+int clip_decompress_block(const char* src, int srclen, char* dst, int dstlen)
+{
+  const unsigned char* p_in = (const unsigned char*) src;
+  int in = 0;
+  int out = 0;
+
+  while (in < srclen) {
+    unsigned char token = p_in[in++];
+    int litlen = token >> 4;
+    int matchlen = (token & 15) + LZ_MINMATCH;
+    int offset = 0;
+    int start = 0;
+
+    if (litlen == 15) {
+      unsigned char byte = 255;
+
+      while (byte == 255 && litlen <= dstlen) {
+	if (in >= srclen)
+	  return -1;
+	byte = p_in[in++];
+	litlen += byte;
+      }
+    }
+
+    if (litlen > srclen - in || litlen > dstlen - out)
+      return -1;
+
+    memcpy(dst + out, p_in + in, litlen);
+    in += litlen;
+    out += litlen;
+
+    if (in == srclen)
+      break; /* The last sequence has no match */
+
+    if (srclen - in < 2)
+      return -1;
+    offset = p_in[in] | p_in[in + 1] << 8;
+    in += 2;
+
+    if (matchlen == 15 + LZ_MINMATCH) {
+      unsigned char byte = 255;
+
+      while (byte == 255 && matchlen <= dstlen) {
+	if (in >= srclen)
+	  return -1;
+	byte = p_in[in++];
+	matchlen += byte;
+      }
+    }
+
+    if (offset == 0 || offset > out || matchlen > dstlen - out)
+      return -1;
+
+    /* The match may overlap the bytes it produces, e.g. with runs of
+     * one character. Copy the repeating pattern as often as it fits
+     * in between, which doubles with every step. */
+    start = out - offset;
+    while (matchlen > 0) {
+      int n = matchlen < out - start ? matchlen : out - start;
+
+      memcpy(dst + out, dst + start, n);
+      out += n;
+      matchlen -= n;
+    }
+  }
+
+  return out;
+}
@@ -0,0 +1,454 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+/* Clipboard history; see tiny_cliphistory(). */
+#define HISTORY_MIN_ENTRIES 64
+
+struct histentry {
+  unsigned long long hash;
+  size_t offset; /* Position of the text in the arena */
+  int len;
+  bool live;     /* false once the text was moved to the front */
+};
+
+struct histslot {
+  bool used;
+  unsigned long long hash;
+  unsigned long long serial; /* Of the entry */
+};
+
+struct history {
+  char* p_arena;
+  size_t budget;               /* Size of p_arena */
+  size_t head;                 /* Where the next text goes */
+  struct histentry* p_entries; /* Ring of entries in arena order */
+  size_t capacity;             /* Size of p_entries, a power of two */
+  unsigned long long first;    /* Serial number of the oldest entry */
+  unsigned long long next;     /* Serial number of the next entry */
+  int live;                    /* Entries not moved to the front */
+  struct histslot* p_slots;    /* Hash table of the live entries */
+  size_t slotcount;            /* Twice the capacity */
+};
+
+static struct history s_history;
+static bool s_history_enabled = false;
+static cliplock s_history_lock = CLIPLOCK_INIT;
+
+/* See hash_text() */
+#define HASH_PRIME1 11400714785074694791ULL
+#define HASH_PRIME2 14029467366897019727ULL
+#define HASH_PRIME3 1609587929392839161ULL
+#define HASH_PRIME4 9650029242287828579ULL
+#define HASH_PRIME5 2870177450012600261ULL
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static bool init_history(struct history* p_hist, size_t budget);
+static void free_history(struct history* p_hist);
+static void add_history(struct history* p_hist, const char* text, int len);
+static struct histentry* get_history(struct history* p_hist, int index);
+static bool fit_history(struct history* p_hist, int len, size_t* p_offset);
+static void evict_history(struct history* p_hist);
+static bool grow_history(struct history* p_hist);
+static long find_history_slot(struct history* p_hist, unsigned long long hash, const char* text, int len);
+static void insert_history_slot(struct history* p_hist, unsigned long long hash, unsigned long long serial);
+static void remove_history_slot(struct history* p_hist, long hole);
+static unsigned long long hash_text(const char* text, int len);
+
+/****************************************
+ * Public API
+ ***************************************/
+
+int tiny_cliphistory(size_t budget)
+{
+  struct history hist;
+  int result = 0;
+
+  clip_lock_exclusive(&s_history_lock);
+
+  if (budget == 0) {
+    __atomic_store_n(&s_history_enabled, false, __ATOMIC_RELEASE);
+    free_history(&s_history);
+  }
+  else if (init_history(&hist, budget)) {
+    /* Keep as many of the newest texts as fit into the new budget */
+    unsigned long long serial;
+    for(serial = s_history.first; serial < s_history.next; serial++) {
+      struct histentry* p_entry = &s_history.p_entries[serial & (s_history.capacity - 1)];
+      if (p_entry->live)
+	add_history(&hist, s_history.p_arena + p_entry->offset, p_entry->len);
+    }
+
+    free_history(&s_history);
+    s_history = hist;
+    __atomic_store_n(&s_history_enabled, true, __ATOMIC_RELEASE);
+  }
+  else {
+    errno = ENOMEM;
+    result = -1;
+  }
+
+  clip_unlock_exclusive(&s_history_lock);
+  return result;
+}
+
+int tiny_cliphistory_count(void)
+{
+  int count = 0;
+
+  clip_lock_shared(&s_history_lock);
+  count = s_history.live;
+  clip_unlock_shared(&s_history_lock);
+
+  return count;
+}
+
+char* tiny_cliphistory_get(int index, int* len)
+{
+  struct histentry* p_entry = NULL;
+  char* outbuf = NULL;
+
+  clip_lock_shared(&s_history_lock);
+
+  if (!(p_entry = get_history(&s_history, index))) { /* Single = intended */
+    clip_unlock_shared(&s_history_lock);
+    errno = ENOENT;
+    return NULL;
+  }
+
+  if (!(outbuf = (char*) malloc(p_entry->len + 1))) { /* Single = intended */
+    clip_unlock_shared(&s_history_lock);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  memcpy(outbuf, s_history.p_arena + p_entry->offset, p_entry->len);
+  outbuf[p_entry->len] = '\0';
+  if (len)
+    *len = p_entry->len;
+
+  clip_unlock_shared(&s_history_lock);
+  return outbuf;
+}
+
+int tiny_cliphistory_recall(int index)
+{
+  int len = 0;
+  int result = 0;
+  char* text = tiny_cliphistory_get(index, &len);
+
+  if (!text)
+    return -1;
+
+  /* This moves the entry to the front as well */
+  result = tiny_clipnwrite(text, len);
+  free(text);
+
+  return result;
+}
+
+/****************************************
+ * Clipboard history
+ ***************************************/
+
+/* The texts live back to back in one arena of `budget' bytes that is
+ * used as a ring: new texts go to `head', and the oldest entries are
+ * evicted until there is room. The entries themselves form a ring in
+ * the same order, addressed by ever-increasing serial numbers. A text
+ * that is already in the history is not stored again; its old entry
+ * is dropped and the text is moved to the front instead. Live entries
+ * are found by their hash through an open addressing table, so that
+ * this check does not depend on the size of the history. */
+
+bool init_history(struct history* p_hist, size_t budget)
+{
+  memset(p_hist, '\0', sizeof(struct history));
+  p_hist->budget = budget;
+  p_hist->capacity = HISTORY_MIN_ENTRIES;
+  p_hist->slotcount = HISTORY_MIN_ENTRIES * 2;
+
+  p_hist->p_arena = (char*) malloc(budget);
+  p_hist->p_entries = (struct histentry*) calloc(p_hist->capacity, sizeof(struct histentry));
+  p_hist->p_slots = (struct histslot*) calloc(p_hist->slotcount, sizeof(struct histslot));
+
+  if (!p_hist->p_arena || !p_hist->p_entries || !p_hist->p_slots) {
+    free_history(p_hist);
+    return false;
+  }
+
+  return true;
+}
+
+void free_history(struct history* p_hist)
+{
+  free(p_hist->p_arena);
+  free(p_hist->p_entries);
+  free(p_hist->p_slots);
+  memset(p_hist, '\0', sizeof(struct history));
+}
+
+/* Adds the text to the history if it is enabled. */
+void clip_remember_text(const char* text, int len)
+{
+  if (!__atomic_load_n(&s_history_enabled, __ATOMIC_ACQUIRE))
+    return;
+
+  clip_lock_exclusive(&s_history_lock);
+  if (s_history.p_arena) /* Might have been disabled meanwhile */
+    add_history(&s_history, text, len);
+  clip_unlock_exclusive(&s_history_lock);
+}
+
+/* Adds `len' bytes of `text' as the newest entry. Texts larger than
+ * the budget are not remembered. */
+void add_history(struct history* p_hist, const char* text, int len)
+{
+  struct histentry* p_entry = NULL;
+  unsigned long long hash = 0;
+  size_t offset = 0;
+  long slot = -1;
+
+  if (len <= 0 || (size_t) len > p_hist->budget)
+    return;
+
+  hash = hash_text(text, len);
+  if ((slot = find_history_slot(p_hist, hash, text, len)) >= 0) { /* Single = intended */
+    unsigned long long serial = p_hist->p_slots[slot].serial;
+
+    STAT_ADD(history_duplicates, 1);
+    if (serial == p_hist->next - 1)
+      return; /* Already the newest entry, nothing to do */
+
+    /* Move it to the front. The old copy's space is reclaimed once
+     * eviction reaches it. */
+    p_hist->p_entries[serial & (p_hist->capacity - 1)].live = false;
+    p_hist->live--;
+    remove_history_slot(p_hist, slot);
+  }
+
+  while (!fit_history(p_hist, len, &offset))
+    evict_history(p_hist);
+
+  if (p_hist->next - p_hist->first == p_hist->capacity && !grow_history(p_hist))
+    return; /* Out of memory; just do not remember it */
+
+  memcpy(p_hist->p_arena + offset, text, len);
+  p_entry = &p_hist->p_entries[p_hist->next & (p_hist->capacity - 1)];
+  p_entry->hash = hash;
+  p_entry->offset = offset;
+  p_entry->len = len;
+  p_entry->live = true;
+  insert_history_slot(p_hist, hash, p_hist->next);
+
+  p_hist->head = offset + len;
+  p_hist->next++;
+  p_hist->live++;
+}
+
+/* Returns the `index'th newest live entry, or NULL. */
+struct histentry* get_history(struct history* p_hist, int index)
+{
+  unsigned long long serial = p_hist->next;
+
+  if (index < 0 || index >= p_hist->live)
+    return NULL;
+
+  while (serial-- > p_hist->first) {
+    struct histentry* p_entry = &p_hist->p_entries[serial & (p_hist->capacity - 1)];
+
+    if (p_entry->live && index-- == 0)
+      return p_entry;
+  }
+
+  return NULL; /* not reached */
+}
+
+/* Checks whether `len' bytes fit into the arena without evicting
+ * anything and if so, stores where in `p_offset'. */
+bool fit_history(struct history* p_hist, int len, size_t* p_offset)
+{
+  size_t tail = 0;
+
+  if (p_hist->first == p_hist->next) { /* Empty */
+    *p_offset = 0;
+    return true;
+  }
+
+  tail = p_hist->p_entries[p_hist->first & (p_hist->capacity - 1)].offset;
+  if (p_hist->head > tail) {
+    /* Free space is behind the head and in front of the tail */
+    if ((size_t) len <= p_hist->budget - p_hist->head)
+      *p_offset = p_hist->head;
+    else if ((size_t) len <= tail)
+      *p_offset = 0;
+    else
+      return false;
+  }
+  else {
+    /* The head has wrapped around; free space is up to the tail */
+    if ((size_t) len <= tail - p_hist->head)
+      *p_offset = p_hist->head;
+    else
+      return false;
+  }
+
+  return true;
+}
+
+/* Drops the oldest entry. */
+void evict_history(struct history* p_hist)
+{
+  struct histentry* p_entry = &p_hist->p_entries[p_hist->first & (p_hist->capacity - 1)];
+
+  if (p_entry->live) {
+    size_t mask = p_hist->slotcount - 1;
+    size_t i = p_entry->hash & mask;
+
+    while (!p_hist->p_slots[i].used || p_hist->p_slots[i].serial != p_hist->first)
+      i = (i + 1) & mask;
+
+    remove_history_slot(p_hist, (long) i);
+    p_hist->live--;
+    STAT_ADD(history_evictions, 1);
+  }
+
+  p_hist->first++;
+  if (p_hist->first == p_hist->next)
+    p_hist->head = 0;
+}
+
+/* Doubles the number of entries the history can hold. */
+bool grow_history(struct history* p_hist)
+{
+  size_t capacity = p_hist->capacity * 2;
+  struct histentry* p_entries = (struct histentry*) calloc(capacity, sizeof(struct histentry));
+  struct histslot* p_slots = (struct histslot*) calloc(capacity * 2, sizeof(struct histslot));
+  unsigned long long serial;
+
+  if (!p_entries || !p_slots) {
+    free(p_entries);
+    free(p_slots);
+    return false;
+  }
+
+  for(serial = p_hist->first; serial < p_hist->next; serial++)
+    p_entries[serial & (capacity - 1)] = p_hist->p_entries[serial & (p_hist->capacity - 1)];
+
+  free(p_hist->p_entries);
+  free(p_hist->p_slots);
+  p_hist->p_entries = p_entries;
+  p_hist->p_slots = p_slots;
+  p_hist->capacity = capacity;
+  p_hist->slotcount = capacity * 2;
+
+  for(serial = p_hist->first; serial < p_hist->next; serial++) {
+    struct histentry* p_entry = &p_entries[serial & (capacity - 1)];
+    if (p_entry->live)
+      insert_history_slot(p_hist, p_entry->hash, serial);
+  }
+
+  return true;
+}
+
+/* Returns the index of the table slot of the live entry with `len'
+ * bytes of `text', or -1. */
+long find_history_slot(struct history* p_hist, unsigned long long hash, const char* text, int len)
+{
+  size_t mask = p_hist->slotcount - 1;
+  size_t i;
+
+  for(i = hash & mask; p_hist->p_slots[i].used; i = (i + 1) & mask) {
+    struct histslot* p_slot = &p_hist->p_slots[i];
+    struct histentry* p_entry = NULL;
+
+    if (p_slot->hash != hash)
+      continue;
+
+    /* Rule out collisions */
+    p_entry = &p_hist->p_entries[p_slot->serial & (p_hist->capacity - 1)];
+    if (p_entry->len == len && memcmp(p_hist->p_arena + p_entry->offset, text, len) == 0)
+      return (long) i;
+  }
+
+  return -1;
+}
+
+void insert_history_slot(struct history* p_hist, unsigned long long hash, unsigned long long serial)
+{
+  size_t mask = p_hist->slotcount - 1;
+  size_t i;
+
+  for(i = hash & mask; p_hist->p_slots[i].used; i = (i + 1) & mask)
+    ;
+
+  p_hist->p_slots[i].used = true;
+  p_hist->p_slots[i].hash = hash;
+  p_hist->p_slots[i].serial = serial;
+}
+
+/* Empties table slot `hole' and moves later slots of the same probe
+ * sequence up, so that lookups need no tombstones. */
+void remove_history_slot(struct history* p_hist, long hole)
+{
+  size_t mask = p_hist->slotcount - 1;
+  size_t i = (size_t) hole;
+  size_t j = i;
+
+  p_hist->p_slots[i].used = false;
+
+  for(;;) {
+    size_t home = 0;
+
+    j = (j + 1) & mask;
+    if (!p_hist->p_slots[j].used)
+      return;
+
+    /* Slots whose home lies between the hole and them stay put */
+    home = p_hist->p_slots[j].hash & mask;
+    if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+      continue;
+
+    p_hist->p_slots[i] = p_hist->p_slots[j];
+    p_hist->p_slots[j].used = false;
+    i = j;
+  }
+}
+
+/* 64-bit hash of `len' bytes at `text', processing eight bytes per
+ * step; modelled after xxHash64 with a single lane. */
+unsigned long long hash_text(const char* text, int len)
+{
+  unsigned long long hash = HASH_PRIME5 + (unsigned long long) len;
+  int i = 0;
+
+  for(; i + 8 <= len; i += 8) {
+    unsigned long long k = 0;
+
+    memcpy(&k, text + i, 8);
+    k *= HASH_PRIME2;
+    k = ROTL64(k, 31);
+    k *= HASH_PRIME1;
+    hash ^= k;
+    hash = ROTL64(hash, 27) * HASH_PRIME1 + HASH_PRIME4;
+  }
+
+  for(; i < len; i++) {
+    hash ^= (unsigned char) text[i] * HASH_PRIME5;
+    hash = ROTL64(hash, 11) * HASH_PRIME1;
+  }
+
+  /* Final avalanche */
+  hash ^= hash >> 33;
+  hash *= HASH_PRIME2;
+  hash ^= hash >> 29;
+  hash *= HASH_PRIME3;
+  hash ^= hash >> 32;
+
+  return hash;
+}
@@ -0,0 +1,183 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+/* Declarations shared by the source files of the library. Each file
+ * implements one part of it: tinyclipboard.c the public API and the
+ * table of backends, x11.c, win32.c and memory.c the backends, owner.c the X11 clipboard owner process, which
+ * owner_main.c runs as a program of its own, and history.c,
+ * prefetch.c, codec.c, stats.c, pipe.c and lock.c what these have in
+ * common. */
+
+#ifndef TINYCLIPBOARD_INTERNAL_H
+#define TINYCLIPBOARD_INTERNAL_H
+
+#ifdef __linux__
+#define _GNU_SOURCE /* memfd_create(), pipe2() */
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <time.h>
+
+#if defined(__unix__)
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <spawn.h>
+#include <sys/select.h>
+#include <poll.h>
+#include <pthread.h>
+#include <langinfo.h>
+#include <iconv.h>
+#include <X11/StringDefs.h>
+#include <X11/Xlib.h>
+#include <X11/Intrinsic.h>
+#include <X11/Xatom.h>
+#elif defined(_WIN32)
+#define WINVER 0x0600 /* >= Windows Vista */
+#include <windows.h>
+#else
+#error Dont know how to access the clipboard on this OS!
+#endif
+
+#include "../include/tinyclipboard.h"
+
+/* Nothing declared below is part of the shared library's interface */
+#if defined(__unix__) && defined(__GNUC__)
+#pragma GCC visibility push(hidden)
+#endif
+
+/* Batches of clipboard data; see tiny_clipbegin(). */
+#define CLIP_MAX_ITEMS 16      /* Entries of a batch */
+#define CLIP_SELECTIONS 2      /* Values of enum tiny_clipselection */
+#define CLIP_MAX_TARGETLEN 255 /* Longest target name */
+
+/* An entry of a batch; see tiny_clipadd(). tiny_clipnwrite() writes a
+ * batch of one entry for the CLIPBOARD text. */
+struct clipitem {
+  int selection;      /* enum tiny_clipselection */
+  const char* target; /* NULL for the text */
+  const char* data;
+  int len;
+};
+
+/* Every piece of state shared between threads is either guarded by a
+ * cliplock or set up exactly once with clip_run_once(); see lock.c. */
+#if defined(__unix__)
+typedef pthread_rwlock_t cliplock;
+typedef pthread_once_t cliponce;
+#define CLIPLOCK_INIT PTHREAD_RWLOCK_INITIALIZER
+#define CLIPONCE_INIT PTHREAD_ONCE_INIT
+#elif defined(_WIN32)
+typedef SRWLOCK cliplock;
+typedef INIT_ONCE cliponce;
+#define CLIPLOCK_INIT SRWLOCK_INIT
+#define CLIPONCE_INIT INIT_ONCE_STATIC_INIT
+#endif
+
+void clip_lock_exclusive(cliplock* p_lock);
+void clip_unlock_exclusive(cliplock* p_lock);
+void clip_lock_shared(cliplock* p_lock);
+void clip_unlock_shared(cliplock* p_lock);
+void clip_run_once(cliponce* p_once, void (*func)(void));
+
+/* Statistics and tracing; see stats.c */
+struct tiny_clipstats* clip_stats(void);
+void clip_trace(enum tiny_clipphase phase);
+void clip_trace_pending(void);
+void clip_trace_owner(enum tiny_clipphase phase);
+unsigned long long clip_monotonic_ns(void);
+
+/* Adds `n' to the counter `field'. Atomic, because on X11 the owner
+ * process updates the same counters. */
+#define STAT_ADD(field, n) __atomic_fetch_add(&clip_stats()->field, (n), __ATOMIC_RELAXED)
+
+/* See tinyclipboard.c */
+bool clip_initialized(void);
+
+/* See history.c */
+void clip_remember_text(const char* text, int len);
+
+/* See prefetch.c */
+char* read_prefetched(int* len);
+void prefetch_written(const char* text, int len);
+
+/* See memory.c */
+char* memory_clipread(int* len);
+int memory_clipnwrite(const char* text, int len);
+
+#if defined(__unix__)
+/* Seconds to wait for the other side of a transfer before giving up */
+#define X11_TIMEOUT 5
+
+/* Header of a batch written into the owner process' pipe, which is
+ * followed by `count' entries */
+struct cliprecord {
+  int count;
+  int compress_threshold; /* See tiny_clipcompress() */
+};
+
+/* Header of an entry of a batch in the pipe, which is followed by the
+ * name of the target and the data */
+struct clipentry {
+  int selection; /* enum tiny_clipselection */
+  int namelen;   /* 0 for the text */
+  int len;
+};
+
+/* Descriptors a spawned owner process (see tiny_clipowner()) finds
+ * the pipe endings and the statistics at */
+#define OWNER_TEXT_FD 3
+#define OWNER_ACK_FD 4
+#define OWNER_STATS_FD 5
+
+/* See stats.c */
+int clip_stats_fd(void);
+void clip_inherit_stats(int filedes);
+
+/* See x11.c */
+char* x11_clipread(int* len);
+char* fetch_x11_clipboard(int maxlen, int* len);
+int x11_clipnwrite(const char* text, int len);
+int x11_clipcommit(const struct clipitem* p_items, int count);
+int x11_clipcompress(int threshold);
+int x11_clipowner(const char* path);
+
+/* See owner.c */
+void own_x11_clipboard(int filedes, int ackfd);
+void child_handle_sigint(int signum);
+Bool is_new_property(Display* p_display, XEvent* p_evt, XPointer arg);
+bool wait_x11_event(Display* p_display, XEvent* p_evt, Bool (*predicate)(Display*, XEvent*, XPointer), XPointer arg, int timeout);
+
+/* See codec.c */
+int clip_compress_block(const char* src, int len, char* dst, int capacity);
+int clip_decompress_block(const char* src, int srclen, char* dst, int dstlen);
+
+/* See pipe.c */
+bool clip_read_pipe(int filedes, void* buf, size_t count);
+bool clip_write_pipe(int filedes, struct iovec* iov, int count);
+int clip_read_ack(int filedes, char* p_ack);
+
+#elif defined(_WIN32)
+/* See win32.c */
+char* win32_clipread(int* len);
+int win32_clipnwrite(const char* text, int len);
+#endif
+
+#if defined(__unix__) && defined(__GNUC__)
+#pragma GCC visibility pop
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+/****************************************
+ * Locking
+ ***************************************/
+
+#if defined(__unix__)
+void clip_lock_exclusive(cliplock* p_lock)
+{
+  pthread_rwlock_wrlock(p_lock);
+}
+
+void clip_unlock_exclusive(cliplock* p_lock)
+{
+  pthread_rwlock_unlock(p_lock);
+}
+
+void clip_lock_shared(cliplock* p_lock)
+{
+  pthread_rwlock_rdlock(p_lock);
+}
+
+void clip_unlock_shared(cliplock* p_lock)
+{
+  pthread_rwlock_unlock(p_lock);
+}
+
+void clip_run_once(cliponce* p_once, void (*func)(void))
+{
+  pthread_once(p_once, func);
+}
+#elif defined(_WIN32)
+void clip_lock_exclusive(cliplock* p_lock)
+{
+  AcquireSRWLockExclusive(p_lock);
+}
+
+void clip_unlock_exclusive(cliplock* p_lock)
+{
+  ReleaseSRWLockExclusive(p_lock);
+}
+
+void clip_lock_shared(cliplock* p_lock)
+{
+  AcquireSRWLockShared(p_lock);
+}
+
+void clip_unlock_shared(cliplock* p_lock)
+{
+  ReleaseSRWLockShared(p_lock);
+}
+
+void clip_run_once(cliponce* p_once, void (*func)(void))
+{
+  BOOL pending = FALSE;
+
+  /* Other threads wait in here until the first one has completed */
+  if (InitOnceBeginInitialize(p_once, 0, &pending, NULL) && pending) {
+    func();
+    InitOnceComplete(p_once, 0, NULL);
+  }
+}
+#endif
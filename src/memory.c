@@ -0,0 +1,91 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+/* Memory backend state */
+static char* s_memory_text = NULL;
+static int s_memory_len = 0;
+static int s_memory_capacity = 0;
+static cliplock s_memory_lock = CLIPLOCK_INIT;
+
+/****************************************
+ * Memory backend
+ ***************************************/
+
+/* Keeps the clipboard in this process' heap. This does not interact
+ * with any other program, but it allows to measure the library's own
+ * overhead without a graphics stack being involved. */
+
+char* memory_clipread(int* len)
+{
+  char* outbuf = NULL;
+
+  clip_lock_shared(&s_memory_lock);
+
+  if (!s_memory_text) {
+    /* Nothing was written yet; equivalent to having no clipboard owner. */
+    clip_unlock_shared(&s_memory_lock);
+    errno = EAGAIN;
+    return NULL;
+  }
+
+  outbuf = (char*) malloc((size_t) s_memory_len + 1);
+  if (!outbuf) {
+    clip_unlock_shared(&s_memory_lock);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  memcpy(outbuf, s_memory_text, s_memory_len);
+  outbuf[s_memory_len] = '\0';
+
+  if (len)
+    *len = s_memory_len;
+
+  clip_unlock_shared(&s_memory_lock);
+  return outbuf;
+}
+
+int memory_clipnwrite(const char* text, int len)
+{
+  char* p_new = NULL;
+
+  if (len < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  clip_lock_exclusive(&s_memory_lock);
+
+  /* Reuse the old buffer if it is large enough already */
+  if (len > s_memory_capacity) {
+    if (!(p_new = (char*) realloc(s_memory_text, len))) { /* Single = intended */
+      clip_unlock_exclusive(&s_memory_lock);
+      errno = ENOMEM;
+      return -1;
+    }
+
+    s_memory_text = p_new;
+    s_memory_capacity = len;
+  }
+  else if (!s_memory_text) {
+    /* Zero-length text on first write; still mark the clipboard as owned. */
+    if (!(s_memory_text = (char*) malloc(1))) { /* Single = intended */
+      clip_unlock_exclusive(&s_memory_lock);
+      errno = ENOMEM;
+      return -1;
+    }
+  }
+
+  memcpy(s_memory_text, text, len);
+  s_memory_len = len;
+
+  clip_unlock_exclusive(&s_memory_lock);
+  return 0;
+}
@@ -0,0 +1,1255 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+#ifdef __unix__
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+/* Texts larger than this many bytes are served in chunks with the
+ * INCR mechanism, which also lets concurrent transfers take turns. */
+#define X11_INCR_CHUNK 65536
+
+/* Maximum number of INCR transfers served at the same time */
+#define X11_MAX_TRANSFERS 128
+
+/* Target names the owner process remembers the atoms of */
+#define X11_ATOM_CACHE 32
+
+/* Seconds without writes or pastes after which the owner process
+ * compresses its texts; see compress_x11_owner(). */
+#define X11_COMPRESS_DELAY 5
+
+/* Clipboard text shared between the owner process and the transfers
+ * serving it; a transfer may outlive the text being replaced. */
+struct cliptext {
+  unsigned int refcount;
+  int len;
+  int stored;               /* Bytes in `text'; less than `len' if compressed */
+  bool incompressible;      /* Compressing it did not pay off */
+  struct cliptext* p_plain; /* Expanded copy kept while a compressed text is pasted, or NULL */
+  char text[];              /* NUL-terminated unless compressed */
+};
+
+/* Per-requestor state of an INCR transfer */
+struct x11_transfer {
+  bool active;
+  Window requestor;
+  Atom property;
+  Atom target;
+  struct cliptext* p_text;  /* Reference keeping `data' alive, or NULL */
+  char* p_owned;            /* Buffer backing `data' owned by the transfer, or NULL */
+  const char* data;
+  size_t len;
+  size_t offset;
+  unsigned long long deadline;
+};
+
+/* Serves SelectionRequests for the selections `window' owns */
+struct x11_server {
+  Display* p_display;
+  Window window;
+  Atom utf8;
+  Atom targets;
+  Atom save_targets;
+  Atom timestamp;
+  Atom incr;
+  size_t chunksize;
+  int active_transfers;
+  struct x11_transfer transfers[X11_MAX_TRANSFERS];
+};
+
+/* Data the owner process offers for one target of a selection */
+struct x11_target {
+  char* p_name;            /* NULL for the text, offered as UTF8_STRING and STRING */
+  Atom atom;               /* Of `p_name', once interned */
+  struct cliptext* p_text;
+};
+
+/* A selection and the targets the owner process offers for it */
+struct x11_selection {
+  Atom atom;
+  bool owning;
+  Time acquired; /* Timestamp ownership was taken with */
+  int count;
+  struct x11_target targets[CLIP_MAX_ITEMS];
+};
+
+/* Target names the owner process has interned already */
+struct x11_atomname {
+  char* p_name;
+  Atom atom;
+};
+
+/* State of the clipboard owner process */
+struct x11_owner {
+  struct x11_server server;
+  struct x11_selection selections[CLIP_SELECTIONS]; /* By enum tiny_clipselection */
+  struct x11_atomname atomnames[X11_ATOM_CACHE];    /* Replaced round-robin */
+  int next_atomname;
+  Atom clipboard_manager;
+  Atom handoff_prop;
+  Atom timestamp_prop;
+  int compress_threshold;              /* Compress the texts if larger; 0 to keep them plain */
+  unsigned long long idle_deadline;    /* See compress_x11_owner(); 0 if not pending */
+  bool handoff_stale;                  /* CLIPBOARD changed during the handoff */
+  unsigned long long handoff_deadline; /* 0 if no handoff is running */
+};
+
+static Window s_clipowner_window = None;
+static bool s_cliptext_served = false;
+
+static struct cliptext* cliptext_new(const char* text, int len);
+static struct cliptext* cliptext_ref(struct cliptext* p_text);
+static void cliptext_unref(struct cliptext* p_text);
+static struct cliptext* cliptext_compress(const struct cliptext* p_text);
+static struct cliptext* cliptext_expand(struct cliptext* p_text);
+static int get_clipboard_text(int filedes, struct x11_selection* p_selections, int* p_threshold, unsigned int* p_named);
+static bool read_x11_target(int filedes, struct x11_selection* p_selections, unsigned int* p_named);
+static int ignore_x11_error(Display* p_display, XErrorEvent* p_evt);
+static void init_x11_server(struct x11_server* p_server, Display* p_display, Window window);
+static void cleanup_x11_server(struct x11_server* p_server);
+static bool send_x11_data(struct x11_server* p_server, XSelectionRequestEvent* p_req, struct cliptext* p_text, char* p_owned, const char* data, size_t len);
+static void continue_x11_transfer(struct x11_server* p_server, XPropertyEvent* p_evt);
+static void finish_x11_transfer(struct x11_server* p_server, struct x11_transfer* p_transfer);
+static long long expire_x11_transfers(struct x11_server* p_server);
+static bool next_x11_event(struct x11_server* p_server, XEvent* p_evt, int filedes, unsigned long long deadline);
+static bool take_x11_ownership(struct x11_owner* p_owner, unsigned int selections);
+static Time get_x11_timestamp(struct x11_owner* p_owner);
+static void intern_x11_targets(struct x11_owner* p_owner);
+static struct x11_selection* find_x11_selection(struct x11_owner* p_owner, Atom atom);
+static const struct x11_target* find_x11_target(const struct x11_selection* p_selection, Atom atom);
+static void clear_x11_selection(struct x11_selection* p_selection);
+static void start_x11_handoff(struct x11_owner* p_owner);
+static void finish_x11_handoff(struct x11_owner* p_owner, bool success);
+static void update_x11_owner(struct x11_owner* p_owner, int* p_filedes, int ackfd);
+static void compress_x11_owner(struct x11_owner* p_owner);
+static void handle_x11_selectionrequest(struct x11_server* p_server, XSelectionRequestEvent* p_req, const struct x11_selection* p_selection);
+
+/****************************************
+ * Clipboard owner process
+ ***************************************/
+
+/* Initiates cililised shutdown by closing the clipboard owner window
+ * (which generates a DestroyNotify event; see XDestroyWindowEvent(3)).
+ * If that fails for whatever reason, calls _exit() directly.
+ */
+void child_handle_sigint(int signum)
+{
+  Display* p_display = NULL;
+
+  /* Exit immediately if there is no window to clean up
+   * (which should never be the case). */
+  if (s_clipowner_window == None)
+    _exit(2);
+
+  if ((p_display = XOpenDisplay(NULL))) { /* Single = intended */
+    XDestroyWindow(p_display, s_clipowner_window);
+    XCloseDisplay(p_display);
+    /* Main code will exit() instead of us */
+  }
+  else {
+    /* No X11 connection, but we are on shutdown. Emergency shutdown. */
+    _exit(2);
+  }
+}
+
+/* Returns a new reference-counted copy of `len' bytes at `text', with
+ * a terminating NUL added. If `text' is NULL, the bytes are left
+ * uninitialised for the caller to fill in. */
+struct cliptext* cliptext_new(const char* text, int len)
+{
+  struct cliptext* p_text = (struct cliptext*) malloc(sizeof(struct cliptext) + len + 1);
+
+  if (!p_text)
+    return NULL;
+
+  p_text->refcount = 1;
+  p_text->len = len;
+  p_text->stored = len;
+  p_text->incompressible = false;
+  p_text->p_plain = NULL;
+  if (text)
+    memcpy(p_text->text, text, len);
+  p_text->text[len] = '\0';
+
+  return p_text;
+}
+
+struct cliptext* cliptext_ref(struct cliptext* p_text)
+{
+  if (p_text)
+    p_text->refcount++;
+
+  return p_text;
+}
+
+void cliptext_unref(struct cliptext* p_text)
+{
+  if (p_text && --p_text->refcount == 0) {
+    cliptext_unref(p_text->p_plain);
+    free(p_text);
+  }
+}
+
+/* Returns a new compressed copy of `p_text', or NULL if compressing
+ * does not save at least an eighth of its size. */
+struct cliptext* cliptext_compress(const struct cliptext* p_text)
+{
+  int capacity = p_text->len - p_text->len / 8;
+  struct cliptext* p_packed = (struct cliptext*) malloc(sizeof(struct cliptext) + capacity);
+  struct cliptext* p_shrunk = NULL;
+  int stored = 0;
+
+  if (!p_packed)
+    return NULL;
+
+  if (!(stored = clip_compress_block(p_text->text, p_text->len, p_packed->text, capacity))) { /* Single = intended */
+    free(p_packed);
+    return NULL;
+  }
+
+  /* Give back what the worst case needed but the text did not */
+  if ((p_shrunk = (struct cliptext*) realloc(p_packed, sizeof(struct cliptext) + stored))) /* Single = intended */
+    p_packed = p_shrunk;
+
+  p_packed->refcount = 1;
+  p_packed->len = p_text->len;
+  p_packed->stored = stored;
+  p_packed->incompressible = false;
+  p_packed->p_plain = NULL;
+
+  return p_packed;
+}
+
+/* Returns a new reference to `p_text' if it is not compressed, or
+ * else to an uncompressed copy of it. The copy is kept with `p_text'
+ * for further requests until compress_x11_owner() drops it. Returns
+ * NULL if it cannot be allocated. */
+struct cliptext* cliptext_expand(struct cliptext* p_text)
+{
+  struct cliptext* p_plain = NULL;
+
+  if (p_text->stored == p_text->len)
+    return cliptext_ref(p_text);
+  if (p_text->p_plain)
+    return cliptext_ref(p_text->p_plain);
+
+  if (!(p_plain = cliptext_new(NULL, p_text->len))) /* Single = intended */
+    return NULL;
+
+  if (clip_decompress_block(p_text->text, p_text->stored, p_plain->text, p_plain->len) != p_plain->len) {
+    fprintf(stderr, "**tinyclipboard: Compressed clipboard text is corrupt. This is likely a bug.\n");
+    cliptext_unref(p_plain);
+    return NULL;
+  }
+
+  STAT_ADD(decompressions, 1);
+  p_text->p_plain = cliptext_ref(p_plain);
+  return p_plain;
+}
+
+/* Reads all batches the parent process has written into the pipe so
+ * far into `p_selections'. A batch replaces the content of each
+ * selection it names entirely, so only the newest content of every
+ * selection is kept. Transfers still running keep their own reference
+ * to the text they started with. The selections named are added to
+ * `p_named' as a bit per enum tiny_clipselection, and the compression
+ * threshold sent along with the newest batch is stored in
+ * `p_threshold'. Returns the number of batches read, or -1 if the
+ * parent has closed its end of the pipe.
+ *
+ * Writers in the parent are serialised, and each waits for its
+ * acknowledgement or kills the owner process (see write_to_owner()),
+ * so in practice there is never more than one batch pending. Reading
+ * until the pipe is empty keeps the owner correct should that change
+ * and costs one extra read() per update. */
+int get_clipboard_text(int filedes, struct x11_selection* p_selections, int* p_threshold, unsigned int* p_named)
+{
+  int count = 0;
+  int i;
+
+  for(;;) {
+    struct x11_selection incoming[CLIP_SELECTIONS];
+    struct cliprecord record;
+    unsigned int named = 0;
+    bool replaced = false;
+    ssize_t ret = 0;
+
+    /* Attempt to read one header from the pipe. Note it has O_NONBLOCK set! */
+    ret = read(filedes, &record, sizeof(struct cliprecord)); /* raw byte read */
+    if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+      return count; /* Reading would block, i.e. no new clipboard data available */
+    else if (ret == 0)
+      return -1; /* Parent process closed the pipe */
+    else if (ret != sizeof(struct cliprecord) || record.count < 0 || record.count > CLIP_MAX_ITEMS)
+      goto fail; /* Transfer protocol violated */
+
+    *p_threshold = record.compress_threshold;
+
+    memset(incoming, '\0', sizeof(incoming));
+    for(i=0; i < record.count; i++) {
+      if (!read_x11_target(filedes, incoming, &named)) {
+	for(i=0; i < CLIP_SELECTIONS; i++)
+	  clear_x11_selection(&incoming[i]);
+	goto fail; /* Transfer protocol violated */
+      }
+    }
+
+    for(i=0; i < CLIP_SELECTIONS; i++) {
+      if (!(named & (1u << i)))
+	continue;
+
+      replaced = replaced || p_selections[i].count > 0;
+      clear_x11_selection(&p_selections[i]);
+      memcpy(p_selections[i].targets, incoming[i].targets, sizeof(incoming[i].targets));
+      p_selections[i].count = incoming[i].count;
+    }
+
+    /* The previous content was replaced before anybody requested it */
+    if (replaced && !s_cliptext_served)
+      STAT_ADD(coalesced_writes, 1);
+    s_cliptext_served = false;
+
+    *p_named |= named;
+    count++;
+  }
+
+  fail:
+    fprintf(stderr, "**tinyclipboard: Parent process violated transfer protocol, discarding. This is likely a bug.\n");
+    for(i=0; i < CLIP_SELECTIONS; i++)
+      clear_x11_selection(&p_selections[i]);
+    return count + 1; /* Still confirm it, so the parent does not wait */
+}
+
+/* Reads one entry of a batch from the pipe and adds it to the
+ * selection it names among `p_selections', which is added to
+ * `p_named'. Returns false if the transfer protocol was violated. */
+bool read_x11_target(int filedes, struct x11_selection* p_selections, unsigned int* p_named)
+{
+  struct x11_selection* p_selection = NULL;
+  struct x11_target* p_target = NULL;
+  struct clipentry entry;
+  int i;
+  int j;
+
+  if (!clip_read_pipe(filedes, &entry, sizeof(struct clipentry))
+      || entry.selection < 0 || entry.selection >= CLIP_SELECTIONS
+      || entry.namelen < 0 || entry.namelen > CLIP_MAX_TARGETLEN || entry.len < 0)
+    return false;
+
+  p_selection = &p_selections[entry.selection];
+  if (p_selection->count == CLIP_MAX_ITEMS)
+    return false;
+  p_target = &p_selection->targets[p_selection->count];
+
+  if (entry.namelen > 0) {
+    if (!(p_target->p_name = (char*) malloc(entry.namelen + 1))) /* Single = intended */
+      return false;
+    p_target->p_name[entry.namelen] = '\0';
+  }
+
+  if ((p_target->p_name && !clip_read_pipe(filedes, p_target->p_name, entry.namelen))
+      || !(p_target->p_text = cliptext_new(NULL, entry.len)) /* Single = intended */
+      || !clip_read_pipe(filedes, p_target->p_text->text, entry.len)) {
+    free(p_target->p_name);
+    cliptext_unref(p_target->p_text);
+    memset(p_target, '\0', sizeof(struct x11_target));
+    return false;
+  }
+
+  p_target->atom = None;
+  p_selection->count++;
+  *p_named |= 1u << entry.selection;
+
+  /* Data written for several targets, usually the same text for
+   * CLIPBOARD and PRIMARY, is kept only once. */
+  for(i=0; i < CLIP_SELECTIONS; i++) {
+    for(j=0; j < p_selections[i].count; j++) {
+      struct cliptext* p_other = p_selections[i].targets[j].p_text;
+
+      if (p_other != p_target->p_text && p_other->len == entry.len
+	  && memcmp(p_other->text, p_target->p_text->text, entry.len) == 0) {
+	cliptext_unref(p_target->p_text);
+	p_target->p_text = cliptext_ref(p_other);
+	return true;
+      }
+    }
+  }
+
+  return true;
+}
+
+Bool is_new_property(Display* p_display, XEvent* p_evt, XPointer arg)
+{
+  return p_evt->type == PropertyNotify
+    && p_evt->xproperty.state == PropertyNewValue
+    && p_evt->xproperty.atom == *((Atom*)arg);
+}
+
+/* Like XIfEvent(), but gives up after `timeout' seconds, in which
+ * case false is returned. */
+bool wait_x11_event(Display* p_display, XEvent* p_evt, Bool (*predicate)(Display*, XEvent*, XPointer), XPointer arg, int timeout)
+{
+  unsigned long long deadline = clip_monotonic_ns() + timeout * 1000000000ULL;
+
+  while (!XCheckIfEvent(p_display, p_evt, predicate, arg)) {
+    unsigned long long now = clip_monotonic_ns();
+    struct pollfd pfd;
+
+    if (now >= deadline)
+      return false;
+
+    pfd.fd = ConnectionNumber(p_display);
+    pfd.events = POLLIN;
+    poll(&pfd, 1, (int)((deadline - now) / 1000000ULL) + 1);
+  }
+
+  return true;
+}
+
+/* Requestors may vanish in the middle of a transfer. The resulting
+ * BadWindow errors must not terminate the serving process, which is
+ * what the default Xlib error handler does. */
+int ignore_x11_error(Display* p_display, XErrorEvent* p_evt)
+{
+  return 0;
+}
+
+/* Prepares `p_server' to serve the selections owned by `window'. */
+void init_x11_server(struct x11_server* p_server, Display* p_display, Window window)
+{
+  static const char* names[] = {"UTF8_STRING", "TARGETS", "SAVE_TARGETS", "TIMESTAMP", "INCR"};
+  Atom atoms[5];
+  long maxlen = XExtendedMaxRequestSize(p_display);
+
+  memset(p_server, '\0', sizeof(struct x11_server));
+  p_server->p_display = p_display;
+  p_server->window = window;
+
+  if (XInternAtoms(p_display, (char**) names, 5, False, atoms))
+    STAT_ADD(x11_roundtrips, 1);
+  p_server->utf8 = atoms[0];
+  p_server->targets = atoms[1];
+  p_server->save_targets = atoms[2];
+  p_server->timestamp = atoms[3];
+  p_server->incr = atoms[4];
+
+  /* Texts that do not fit into a single request must be sent with
+   * INCR; leave some room for the request header. Smaller chunks also
+   * let concurrent transfers take turns more often. */
+  if (!maxlen)
+    maxlen = XMaxRequestSize(p_display);
+  p_server->chunksize = maxlen * 4 - 1024;
+  if (p_server->chunksize > X11_INCR_CHUNK)
+    p_server->chunksize = X11_INCR_CHUNK;
+}
+
+/* Drops all transfers still running. */
+void cleanup_x11_server(struct x11_server* p_server)
+{
+  int i;
+
+  for(i=0; i < X11_MAX_TRANSFERS; i++) {
+    if (p_server->transfers[i].active)
+      finish_x11_transfer(p_server, &p_server->transfers[i]);
+  }
+}
+
+/* Sends `len' bytes of `data' as `p_req''s target to its requestor,
+ * either directly or by starting an INCR transfer. The transfer keeps
+ * a reference to `p_text' and takes ownership of `p_owned' (either
+ * may be NULL); these are expected to back `data'. Returns false if
+ * the data could not be sent. */
+bool send_x11_data(struct x11_server* p_server, XSelectionRequestEvent* p_req, struct cliptext* p_text, char* p_owned, const char* data, size_t len)
+{
+  struct x11_transfer* p_transfer = NULL;
+  long announced = (long) len;
+  int i;
+
+  if (len <= p_server->chunksize) {
+    XChangeProperty(p_server->p_display, p_req->requestor, p_req->property,
+		    p_req->target, 8, PropModeReplace,
+		    (const unsigned char*) data, (int) len);
+    STAT_ADD(bytes_served, len);
+    free(p_owned);
+    return true;
+  }
+
+  /* Find a free transfer slot */
+  for(i=0; i < X11_MAX_TRANSFERS; i++) {
+    if (!p_server->transfers[i].active) {
+      p_transfer = &p_server->transfers[i];
+      break;
+    }
+  }
+
+  if (!p_transfer) {
+    fprintf(stderr, "**tinyclipboard: Too many concurrent transfers, refusing request.\n");
+    free(p_owned);
+    return false;
+  }
+
+  p_transfer->active = true;
+  p_transfer->requestor = p_req->requestor;
+  p_transfer->property = p_req->property;
+  p_transfer->target = p_req->target;
+  p_transfer->p_text = cliptext_ref(p_text);
+  p_transfer->p_owned = p_owned;
+  p_transfer->data = data;
+  p_transfer->len = len;
+  p_transfer->offset = 0;
+  p_transfer->deadline = clip_monotonic_ns() + X11_TIMEOUT * 1000000000ULL;
+  p_server->active_transfers++;
+  STAT_ADD(incr_transfers, 1);
+
+  /* The requestor deleting the property asks for the next chunk. */
+  XSelectInput(p_server->p_display, p_req->requestor, PropertyChangeMask);
+  XChangeProperty(p_server->p_display, p_req->requestor, p_req->property,
+		  p_server->incr, 32, PropModeReplace,
+		  (const unsigned char*) &announced, 1);
+
+  return true;
+}
+
+/* Sends the next chunk of the INCR transfer the property event
+ * `p_evt' belongs to, if any. */
+void continue_x11_transfer(struct x11_server* p_server, XPropertyEvent* p_evt)
+{
+  int i;
+
+  if (p_evt->state != PropertyDelete || p_server->active_transfers == 0)
+    return;
+
+  for(i=0; i < X11_MAX_TRANSFERS; i++) {
+    struct x11_transfer* p_transfer = &p_server->transfers[i];
+    size_t chunklen = 0;
+
+    if (!p_transfer->active || p_transfer->requestor != p_evt->window || p_transfer->property != p_evt->atom)
+      continue;
+
+    chunklen = p_transfer->len - p_transfer->offset;
+    if (chunklen > p_server->chunksize)
+      chunklen = p_server->chunksize;
+
+    /* A zero-length chunk after the last one ends the transfer. */
+    XChangeProperty(p_server->p_display, p_transfer->requestor, p_transfer->property,
+		    p_transfer->target, 8, PropModeReplace,
+		    (const unsigned char*) p_transfer->data + p_transfer->offset, (int) chunklen);
+    STAT_ADD(bytes_served, chunklen);
+
+    if (chunklen == 0) {
+      finish_x11_transfer(p_server, p_transfer);
+    }
+    else {
+      p_transfer->offset += chunklen;
+      p_transfer->deadline = clip_monotonic_ns() + X11_TIMEOUT * 1000000000ULL;
+    }
+
+    return;
+  }
+}
+
+void finish_x11_transfer(struct x11_server* p_server, struct x11_transfer* p_transfer)
+{
+  int i;
+
+  p_transfer->active = false;
+  p_server->active_transfers--;
+  cliptext_unref(p_transfer->p_text);
+  free(p_transfer->p_owned);
+  p_transfer->p_text = NULL;
+  p_transfer->p_owned = NULL;
+
+  /* Stop listening on the requestor unless it has more transfers going */
+  for(i=0; i < X11_MAX_TRANSFERS; i++) {
+    if (p_server->transfers[i].active && p_server->transfers[i].requestor == p_transfer->requestor)
+      return;
+  }
+
+  XSelectInput(p_server->p_display, p_transfer->requestor, NoEventMask);
+}
+
+/* Drops transfers whose requestors did not ask for the next chunk in
+ * time, e.g. because they crashed. Returns the number of nanoseconds
+ * until the next transfer would expire, or -1 if there are none. */
+long long expire_x11_transfers(struct x11_server* p_server)
+{
+  unsigned long long now = 0;
+  long long next = -1;
+  int i;
+
+  if (p_server->active_transfers == 0)
+    return -1;
+
+  now = clip_monotonic_ns();
+  for(i=0; i < X11_MAX_TRANSFERS; i++) {
+    struct x11_transfer* p_transfer = &p_server->transfers[i];
+
+    if (!p_transfer->active)
+      continue;
+
+    if (p_transfer->deadline <= now) {
+      STAT_ADD(transfers_expired, 1);
+      finish_x11_transfer(p_server, p_transfer);
+    }
+    else if (next < 0 || (long long)(p_transfer->deadline - now) < next) {
+      next = (long long)(p_transfer->deadline - now);
+    }
+  }
+
+  return next;
+}
+
+/* Waits for the next X event of `p_server''s display, which is the
+ * one event loop all transfers are driven from, and drops expired
+ * transfers meanwhile. Returns false without an event if `filedes'
+ * (if >= 0) becomes readable or the time `deadline' (if not 0) is
+ * reached first. */
+bool next_x11_event(struct x11_server* p_server, XEvent* p_evt, int filedes, unsigned long long deadline)
+{
+  Display* p_display = p_server->p_display;
+
+  while (!XPending(p_display)) {
+    int xfd = ConnectionNumber(p_display);
+    long long timeout = expire_x11_transfers(p_server);
+    struct timeval tv;
+    fd_set fds;
+
+    if (deadline) {
+      unsigned long long now = clip_monotonic_ns();
+
+      if (now >= deadline)
+	return false;
+      if (timeout < 0 || (long long)(deadline - now) < timeout)
+	timeout = (long long)(deadline - now);
+    }
+
+    FD_ZERO(&fds);
+    FD_SET(xfd, &fds);
+    if (filedes >= 0)
+      FD_SET(filedes, &fds);
+
+    /* Round up so that the deadline has passed on wakeup */
+    tv.tv_sec = (timeout / 1000 + 1) / 1000000;
+    tv.tv_usec = (timeout / 1000 + 1) % 1000000;
+
+    if (select((xfd > filedes ? xfd : filedes) + 1, &fds, NULL, NULL, timeout < 0 ? NULL : &tv) <= 0)
+      continue; /* Timeout or EINTR, e.g. from child_handle_sigint() */
+
+    if (filedes >= 0 && FD_ISSET(filedes, &fds))
+      return false;
+  }
+
+  XNextEvent(p_display, p_evt);
+  expire_x11_transfers(p_server);
+  return true;
+}
+
+/* Makes `p_owner''s window the owner of `selections' (a bit per enum
+ * tiny_clipselection), all with the same new timestamp. This is done
+ * again for selections we own already, so that TIMESTAMP tells the
+ * time of the current content and XFixes clients (such as another
+ * process' prefetch thread) learn about the change. Returns false if
+ * another client was faster for any of them. */
+bool take_x11_ownership(struct x11_owner* p_owner, unsigned int selections)
+{
+  Display* p_display = p_owner->server.p_display;
+  unsigned int taken = 0;
+  Time now = CurrentTime;
+  bool result = true;
+  int i;
+
+  for(i=0; i < CLIP_SELECTIONS; i++) {
+    struct x11_selection* p_selection = &p_owner->selections[i];
+
+    if (!(selections & (1u << i)))
+      continue;
+
+    if (!taken)
+      now = get_x11_timestamp(p_owner);
+    XSetSelectionOwner(p_display, p_selection->atom, p_owner->server.window, now);
+    p_selection->acquired = now;
+    taken |= 1u << i;
+  }
+
+  for(i=0; i < CLIP_SELECTIONS; i++) {
+    struct x11_selection* p_selection = &p_owner->selections[i];
+
+    if (taken & (1u << i)) {
+      STAT_ADD(x11_roundtrips, 1);
+      p_selection->owning = XGetSelectionOwner(p_display, p_selection->atom) == p_owner->server.window;
+    }
+    if (selections & (1u << i))
+      result = result && p_selection->owning;
+  }
+
+  return result;
+}
+
+/* Returns the current server time, which the server reports for a
+ * change of a property on our window (ICCCM section 2.1). Taking
+ * ownership with CurrentTime instead would let an older request of
+ * another client win. */
+Time get_x11_timestamp(struct x11_owner* p_owner)
+{
+  Display* p_display = p_owner->server.p_display;
+  XEvent evt;
+
+  /* Appending nothing changes nothing but still generates the event */
+  XChangeProperty(p_display, p_owner->server.window, p_owner->timestamp_prop,
+		  XA_INTEGER, 8, PropModeAppend, NULL, 0);
+  if (!wait_x11_event(p_display, &evt, is_new_property, (XPointer)&p_owner->timestamp_prop, X11_TIMEOUT))
+    return CurrentTime;
+  STAT_ADD(x11_roundtrips, 1);
+
+  return evt.xproperty.time;
+}
+
+/* Looks up the atoms of the targets added with tiny_clipadd(). Names
+ * not seen recently are interned with a single request. */
+void intern_x11_targets(struct x11_owner* p_owner)
+{
+  char* names[CLIP_SELECTIONS * CLIP_MAX_ITEMS];
+  Atom* p_atoms[CLIP_SELECTIONS * CLIP_MAX_ITEMS];
+  Atom atoms[CLIP_SELECTIONS * CLIP_MAX_ITEMS];
+  int missing = 0;
+  int i;
+  int j;
+  int k;
+
+  for(i=0; i < CLIP_SELECTIONS; i++) {
+    for(j=0; j < p_owner->selections[i].count; j++) {
+      struct x11_target* p_target = &p_owner->selections[i].targets[j];
+
+      if (!p_target->p_name || p_target->atom != None)
+	continue;
+
+      for(k=0; k < X11_ATOM_CACHE; k++) {
+	struct x11_atomname* p_cached = &p_owner->atomnames[k];
+
+	if (p_cached->p_name && strcmp(p_cached->p_name, p_target->p_name) == 0) {
+	  p_target->atom = p_cached->atom;
+	  break;
+	}
+      }
+
+      if (p_target->atom == None) {
+	names[missing] = p_target->p_name;
+	p_atoms[missing++] = &p_target->atom;
+      }
+    }
+  }
+
+  if (missing == 0)
+    return;
+
+  if (XInternAtoms(p_owner->server.p_display, names, missing, False, atoms))
+    STAT_ADD(x11_roundtrips, 1);
+
+  for(i=0; i < missing; i++) {
+    struct x11_atomname* p_cached = &p_owner->atomnames[p_owner->next_atomname];
+    char* p_name = (char*) malloc(strlen(names[i]) + 1);
+
+    *p_atoms[i] = atoms[i];
+
+    /* The same name may be missing twice, e.g. for both selections */
+    for(k=0; k < i; k++) {
+      if (strcmp(names[k], names[i]) == 0)
+	break;
+    }
+    if (k < i || !p_name) {
+      free(p_name);
+      continue;
+    }
+
+    strcpy(p_name, names[i]);
+    free(p_cached->p_name);
+    p_cached->p_name = p_name;
+    p_cached->atom = atoms[i];
+    p_owner->next_atomname = (p_owner->next_atomname + 1) % X11_ATOM_CACHE;
+  }
+}
+
+/* Returns the selection of `p_owner' called `atom', or NULL. */
+struct x11_selection* find_x11_selection(struct x11_owner* p_owner, Atom atom)
+{
+  int i;
+
+  for(i=0; i < CLIP_SELECTIONS; i++) {
+    if (p_owner->selections[i].atom == atom)
+      return &p_owner->selections[i];
+  }
+
+  return NULL;
+}
+
+/* Returns the target `atom' of `p_selection' (which may be NULL), or
+ * NULL if it has none. None stands for the text. Targets without data
+ * are not offered, just like an empty text. */
+const struct x11_target* find_x11_target(const struct x11_selection* p_selection, Atom atom)
+{
+  int i;
+
+  if (!p_selection)
+    return NULL;
+
+  for(i=0; i < p_selection->count; i++) {
+    const struct x11_target* p_target = &p_selection->targets[i];
+
+    if (p_target->p_text->len > 0 && (atom == None ? !p_target->p_name : p_target->p_name && p_target->atom == atom))
+      return p_target;
+  }
+
+  return NULL;
+}
+
+/* Drops the content of `p_selection', but not its ownership. */
+void clear_x11_selection(struct x11_selection* p_selection)
+{
+  int i;
+
+  for(i=0; i < p_selection->count; i++) {
+    free(p_selection->targets[i].p_name);
+    cliptext_unref(p_selection->targets[i].p_text);
+  }
+
+  memset(p_selection->targets, '\0', sizeof(p_selection->targets));
+  p_selection->count = 0;
+}
+
+/* Asks a running clipboard manager to take over CLIPBOARD, which it
+ * does by requesting the text from us. The outcome is handled by
+ * finish_x11_handoff() when the manager answers or the deadline
+ * passes; until then we simply stay the owner, which is also the
+ * fallback if the manager fails. */
+void start_x11_handoff(struct x11_owner* p_owner)
+{
+  Display* p_display = p_owner->server.p_display;
+
+  STAT_ADD(x11_roundtrips, 1);
+  if (XGetSelectionOwner(p_display, p_owner->clipboard_manager) == None)
+    return;
+
+  /* Give a property, so that success can be told from failure */
+  XConvertSelection(p_display, p_owner->clipboard_manager, p_owner->server.save_targets,
+		    p_owner->handoff_prop, p_owner->server.window, CurrentTime);
+  XFlush(p_display);
+
+  p_owner->handoff_deadline = clip_monotonic_ns() + X11_TIMEOUT * 1000000000ULL;
+  p_owner->handoff_stale = false;
+}
+
+/* Called when the clipboard manager answered (`success' tells how)
+ * or did not answer in time. */
+void finish_x11_handoff(struct x11_owner* p_owner, bool success)
+{
+  bool stale = p_owner->handoff_stale;
+
+  p_owner->handoff_deadline = 0;
+  p_owner->handoff_stale = false;
+
+  if (success)
+    STAT_ADD(manager_handoffs, 1);
+  else
+    STAT_ADD(manager_failures, 1);
+  clip_trace_owner(TINY_CLIPPHASE_WRITE_MANAGER);
+
+  /* CLIPBOARD changed while the manager was busy copying the old
+   * content. It might now own CLIPBOARD with that, so take it back and
+   * try again with the current content. */
+  if (stale && take_x11_ownership(p_owner, 1u << TINY_CLIPSELECTION_CLIPBOARD))
+    start_x11_handoff(p_owner);
+}
+
+/* Takes all new batches from the parent process' pipe, takes
+ * ownership of the selections they name and confirms each on the
+ * `ackfd' pipe; see clip_read_ack(). */
+void update_x11_owner(struct x11_owner* p_owner, int* p_filedes, int ackfd)
+{
+  unsigned int named = 0;
+  int count = 0;
+  char ack = 0;
+
+  if (*p_filedes < 0)
+    return;
+
+  count = get_clipboard_text(*p_filedes, p_owner->selections, &p_owner->compress_threshold, &named);
+  if (count < 0) {
+    *p_filedes = -1; /* Parent is gone; keep serving the last content */
+    return;
+  }
+  else if (count == 0) {
+    return;
+  }
+
+  p_owner->idle_deadline = clip_monotonic_ns() + X11_COMPRESS_DELAY * 1000000000ULL;
+  intern_x11_targets(p_owner);
+  if (take_x11_ownership(p_owner, named))
+    ack = 0;
+  else
+    ack = 1;
+
+  while (count-- > 0)
+    write(ackfd, &ack, 1);
+
+  /* Clipboard managers only care about CLIPBOARD */
+  if (!(named & (1u << TINY_CLIPSELECTION_CLIPBOARD)) || !p_owner->selections[TINY_CLIPSELECTION_CLIPBOARD].owning)
+    return;
+
+  /* Only one handoff at a time; see finish_x11_handoff(). */
+  if (p_owner->handoff_deadline)
+    p_owner->handoff_stale = true;
+  else
+    start_x11_handoff(p_owner);
+}
+
+/* Once nothing has been written or pasted for X11_COMPRESS_DELAY
+ * seconds, replaces the texts of all targets with compressed copies
+ * if they are larger than the threshold of the newest batch, and
+ * drops the expanded copies that were kept for pasting compressed
+ * ones. A burst of pastes thus expands a text only once, and a text
+ * that is replaced right away is never compressed. Running transfers
+ * postpone this, and so does a running handoff, as the clipboard
+ * manager requests the whole content right away. */
+void compress_x11_owner(struct x11_owner* p_owner)
+{
+  unsigned long long now = 0;
+  unsigned long compressions = 0;
+  unsigned long saved = 0;
+  bool freed = false;
+  int i;
+  int j;
+
+  if (!p_owner->idle_deadline || p_owner->handoff_deadline)
+    return;
+
+  now = clip_monotonic_ns();
+  if (now < p_owner->idle_deadline)
+    return;
+  if (p_owner->server.active_transfers > 0) {
+    p_owner->idle_deadline = now + X11_COMPRESS_DELAY * 1000000000ULL;
+    return;
+  }
+  p_owner->idle_deadline = 0;
+
+  for(i=0; i < CLIP_SELECTIONS; i++) {
+    for(j=0; j < p_owner->selections[i].count; j++) {
+      struct cliptext* p_text = p_owner->selections[i].targets[j].p_text;
+      struct cliptext* p_packed = NULL;
+      int k;
+      int l;
+
+      if (p_text->p_plain) {
+	cliptext_unref(p_text->p_plain);
+	p_text->p_plain = NULL;
+	freed = true;
+	continue;
+      }
+
+      /* A text shared by several targets is compressed once */
+      if (!p_owner->compress_threshold || p_text->len <= p_owner->compress_threshold
+	  || p_text->stored < p_text->len || p_text->incompressible)
+	continue;
+      if (!(p_packed = cliptext_compress(p_text))) { /* Single = intended */
+	p_text->incompressible = true; /* Do not try again after every paste */
+	continue;
+      }
+
+      compressions++;
+      saved += p_text->len - p_packed->stored;
+      freed = true;
+
+      cliptext_ref(p_text); /* Until all targets have been compared */
+      for(k=0; k < CLIP_SELECTIONS; k++) {
+	for(l=0; l < p_owner->selections[k].count; l++) {
+	  struct x11_target* p_target = &p_owner->selections[k].targets[l];
+
+	  if (p_target->p_text == p_text) {
+	    p_target->p_text = cliptext_ref(p_packed);
+	    cliptext_unref(p_text);
+	  }
+	}
+      }
+      cliptext_unref(p_text);
+      cliptext_unref(p_packed);
+    }
+  }
+
+  if (!freed)
+    return;
+
+#ifdef __GLIBC__
+  /* The freed text is usually not at the top of the heap, so that the
+   * memory would stay with the process otherwise. */
+  malloc_trim(0);
+#endif
+
+  /* Only now that the memory is gone, so that watchers of the
+   * counters see the owner process at its new size */
+  STAT_ADD(compressions, compressions);
+  STAT_ADD(bytes_saved, saved);
+}
+
+void own_x11_clipboard(int filedes, int ackfd)
+{
+  static const char* names[] = {"CLIPBOARD", "CLIPBOARD_MANAGER", "TINYCLIP_SAVE", "TINYCLIP_TIMESTAMP"};
+  Display* p_display = NULL;
+  struct x11_owner owner;
+  Atom atoms[4];
+  int terminate = 0;
+  int i;
+
+#ifdef __GLIBC__
+  /* Keep texts above the initial threshold in mappings of their own,
+   * so that replacing one gives its memory back. glibc would raise
+   * the threshold with the first such text freed, and the owner would
+   * stay as large as the largest text it ever held. */
+  mallopt(M_MMAP_THRESHOLD, 128 * 1024);
+#endif
+
+  p_display = XOpenDisplay(NULL);
+  if (!p_display) {
+    fprintf(stderr, "**tinyclipboard: Failed to open X11 display connection.\n");
+    _exit(1);
+    return;
+  }
+  STAT_ADD(x11_roundtrips, 1);
+
+  XSetErrorHandler(ignore_x11_error);
+  s_clipowner_window = XCreateSimpleWindow(p_display, XDefaultRootWindow(p_display), 0, 0, 1, 1, 0, 0, 0);
+
+  memset(&owner, '\0', sizeof(struct x11_owner));
+  init_x11_server(&owner.server, p_display, s_clipowner_window);
+  if (XInternAtoms(p_display, (char**) names, 4, False, atoms))
+    STAT_ADD(x11_roundtrips, 1);
+  owner.selections[TINY_CLIPSELECTION_CLIPBOARD].atom = atoms[0]; /* CLIPBOARD (= win32-like clipboard) */
+  owner.selections[TINY_CLIPSELECTION_PRIMARY].atom = XA_PRIMARY; /* Marked text */
+  owner.clipboard_manager = atoms[1]; /* Owned by the clipboard manager, if any */
+  owner.handoff_prop = atoms[2];      /* Receives the manager's answer */
+  owner.timestamp_prop = atoms[3];    /* See get_x11_timestamp() */
+
+  /* Tell X.org we want to receive the DestroyNotify event; see
+   * - https://tronche.com/gui/x/xlib/events/window-state-change/destroy.html
+   * - http://www.lemoda.net/c/xlib-resize/
+   * Property changes tell the server time; see get_x11_timestamp(). */
+  XSelectInput(p_display, s_clipowner_window, StructureNotifyMask | PropertyChangeMask);
+
+  /* Ownership is taken with the first text from the pipe. */
+  while (!terminate) {
+    struct x11_selection* p_selection = NULL;
+    XEvent evt;
+
+    /* Nothing left to do if the parent is gone and somebody else
+     * took over CLIPBOARD. */
+    if (filedes < 0 && !owner.selections[TINY_CLIPSELECTION_CLIPBOARD].owning && !owner.selections[TINY_CLIPSELECTION_PRIMARY].owning
+	&& owner.server.active_transfers == 0 && !owner.handoff_deadline)
+      break;
+
+    /* The idle timer only runs while there is no handoff; see
+     * compress_x11_owner(). */
+    if (!next_x11_event(&owner.server, &evt, filedes, owner.handoff_deadline ? owner.handoff_deadline : owner.idle_deadline)) {
+      update_x11_owner(&owner, &filedes, ackfd);
+
+      if (owner.handoff_deadline && clip_monotonic_ns() >= owner.handoff_deadline)
+	finish_x11_handoff(&owner, false); /* Clipboard manager is wedged */
+
+      compress_x11_owner(&owner);
+      continue;
+    }
+
+    switch(evt.type) {
+    case SelectionRequest:
+      update_x11_owner(&owner, &filedes, ackfd);
+      handle_x11_selectionrequest(&owner.server, &evt.xselectionrequest, find_x11_selection(&owner, evt.xselectionrequest.selection));
+      owner.idle_deadline = clip_monotonic_ns() + X11_COMPRESS_DELAY * 1000000000ULL;
+      s_cliptext_served = true;
+      break;
+    case SelectionNotify: /* Clipboard manager answered */
+      if (owner.handoff_deadline && evt.xselection.target == owner.server.save_targets) {
+	if (evt.xselection.property != None)
+	  XDeleteProperty(p_display, s_clipowner_window, evt.xselection.property);
+	finish_x11_handoff(&owner, evt.xselection.property != None);
+      }
+      break;
+    case PropertyNotify: /* A requestor wants the next INCR chunk */
+      continue_x11_transfer(&owner.server, &evt.xproperty);
+      break;
+    case SelectionClear: /* We are no longer the owner. Transfers
+			  * already begun are completed, as ICCCM wants. */
+      if ((p_selection = find_x11_selection(&owner, evt.xselectionclear.selection))) /* Single = intended */
+	p_selection->owning = false;
+      break;
+    case DestroyNotify: /* X11 killed the window */
+      if (evt.xdestroywindow.window == s_clipowner_window) {
+	s_clipowner_window = None;
+	terminate = 1;
+      }
+      break;
+    default:
+      break; /* Ignore unsupported event */
+    }
+  }
+
+  cleanup_x11_server(&owner.server);
+  for(i=0; i < CLIP_SELECTIONS; i++)
+    clear_x11_selection(&owner.selections[i]);
+  for(i=0; i < X11_ATOM_CACHE; i++)
+    free(owner.atomnames[i].p_name);
+  if (s_clipowner_window != None)
+    XDestroyWindow(p_display, s_clipowner_window);
+  XCloseDisplay(p_display);
+}
+
+void handle_x11_selectionrequest(struct x11_server* p_server, XSelectionRequestEvent* p_req, const struct x11_selection* p_selection)
+{
+  Display* p_display = p_server->p_display;
+  const struct x11_target* p_text = find_x11_target(p_selection, None);
+  const struct x11_target* p_data = NULL;
+  struct cliptext* p_plain = NULL;
+  bool filled = p_selection && p_selection->count > 0;
+  int textlen = 0;
+  XEvent response;
+
+  clip_trace_owner(TINY_CLIPPHASE_SERVE_BEGIN);
+
+  /* The text is offered as UTF8_STRING and STRING, everything else
+   * under the target it was added with. */
+  if (p_req->target == p_server->utf8 || p_req->target == XA_STRING)
+    p_data = p_text;
+  else if (p_req->target != None)
+    p_data = find_x11_target(p_selection, p_req->target);
+
+  /* A compressed text is expanded for the first request of its
+   * content; see cliptext_expand(). */
+  if (p_data && (p_plain = cliptext_expand(p_data->p_text))) /* Single = intended */
+    textlen = p_plain->len;
+
+  /* Obsolete clients do not name a property; ICCCM says to use the
+   * target's name then. */
+  if (p_req->property == None)
+    p_req->property = p_req->target;
+
+  response.xselection.type	= SelectionNotify;
+  response.xselection.display	= p_req->display;
+  response.xselection.requestor = p_req->requestor;
+  response.xselection.selection = p_req->selection;
+  response.xselection.target	= p_req->target;
+  response.xselection.time	= p_req->time;
+
+  if (filled && (p_req->target == p_server->targets)) { /* Request for supported clipboard targets */
+    Atom supported_targets[5 + CLIP_MAX_ITEMS];
+    int count = 0;
+    int i;
+
+    supported_targets[count++] = p_server->targets;
+    supported_targets[count++] = p_server->timestamp;
+    supported_targets[count++] = p_server->save_targets;
+    if (p_text) {
+      supported_targets[count++] = p_server->utf8;
+      supported_targets[count++] = XA_STRING;
+    }
+    for(i=0; i < p_selection->count; i++) {
+      if (p_selection->targets[i].p_name && find_x11_target(p_selection, p_selection->targets[i].atom))
+	supported_targets[count++] = p_selection->targets[i].atom;
+    }
+
+    STAT_ADD(served_targets, 1);
+    response.xselection.property = p_req->property;
+    XChangeProperty(p_display,
+		    p_req->requestor,
+		    p_req->property,
+		    XA_ATOM,
+		    32, /* Xlib wants an array of longs here */
+		    PropModeReplace,
+		    (unsigned char*)(&supported_targets),
+		    count);
+  }
+  else if (filled && p_req->target == p_server->timestamp) { /* Time we took ownership with */
+    long acquired = (long) p_selection->acquired;
+    STAT_ADD(served_targets, 1);
+    response.xselection.property = p_req->property;
+    XChangeProperty(p_display, p_req->requestor, p_req->property,
+		    XA_INTEGER, 32, PropModeReplace, (unsigned char*) &acquired, 1);
+  }
+  else if (filled && p_req->target == p_server->save_targets) {
+    /* This is a No-op target as per freedesktop.org spec. */
+    STAT_ADD(served_save_targets, 1);
+    response.xselection.property = None;
+  }
+  else if (textlen > 0 && p_req->target == p_server->utf8) { /* Request for real text content, UTF-8 requested */
+    STAT_ADD(served_utf8, 1);
+    if (send_x11_data(p_server, p_req, p_plain, NULL, p_plain->text, textlen))
+      response.xselection.property = p_req->property;
+    else
+      response.xselection.property = None;
+  }
+  else if (textlen > 0 && p_req->target == XA_STRING) { /* Request for locale-dependant encoded text -- UNTESTED with non-utf8-locales*/
+    const char* locale_encoding = nl_langinfo(CODESET);
+    iconv_t converter = iconv_open(locale_encoding, "UTF-8");
+    char* source_string = p_plain->text; /* iconv() does not change it, but the function prototype is broken */
+    size_t bytes_allocated = textlen; /* Enough unless the locale's encoding takes more bytes than UTF-8 */
+    char* target_string = (char*) calloc(bytes_allocated, 1);
+    char* outbuf = target_string;
+    size_t inbytesleft = textlen;
+    size_t outbytesleft = bytes_allocated;
+
+    STAT_ADD(served_string, 1);
+
+    /* Convert from UTF-8 to locale's encoding. */
+    while (inbytesleft > 0) {
+      if (iconv(converter, &source_string, &inbytesleft, &outbuf, &outbytesleft) == ((size_t)-1)) {
+	if (errno == E2BIG) {
+	  size_t used = outbuf - target_string;
+
+	  target_string = (char*) realloc(target_string, bytes_allocated * 2);
+	  outbuf = target_string + used;
+
+	  outbytesleft += bytes_allocated;
+	  bytes_allocated *= 2;
+	}
+	else {
+	  perror("**tinyclipboard: Failed to convert string into locale encoding");
+	  response.xselection.property = None;
+	  XSendEvent(p_display, p_req->requestor, 0, 0, &response);
+	  iconv_close(converter);
+	  free(target_string);
+	  cliptext_unref(p_plain);
+	  clip_trace_owner(TINY_CLIPPHASE_SERVE_END);
+	  return;
+	}
+      }
+    }
+    iconv_close(converter);
+
+    /* The following is the same as with utf8 above, just with another
+     * charset. The converted string is owned by the transfer now. */
+    if (send_x11_data(p_server, p_req, NULL, target_string, target_string, bytes_allocated - outbytesleft))
+      response.xselection.property = p_req->property;
+    else
+      response.xselection.property = None;
+  }
+  else if (textlen > 0) { /* Request for a target added with tiny_clipadd(), sent as is */
+    STAT_ADD(served_added, 1);
+    if (send_x11_data(p_server, p_req, p_plain, NULL, p_plain->text, textlen))
+      response.xselection.property = p_req->property;
+    else
+      response.xselection.property = None;
+  }
+  else { /* Unsupported target requested or textlen <= 0 (i.e. empty clipboard) */
+    STAT_ADD(served_other, 1);
+    response.xselection.property = None;
+  }
+
+  XSendEvent(p_display, p_req->requestor, 0, 0, &response);
+  cliptext_unref(p_plain);
+  clip_trace_owner(TINY_CLIPPHASE_SERVE_END);
+}
+#endif
@@ -0,0 +1,34 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+/****************************************
+ * Owner program
+ ***************************************/
+
+/* Entry point of tinyclipboard-owner, the clipboard owner process
+ * started by spawn_owner() in x11.c. With "--stats",
+ * the parent's statistics are at OWNER_STATS_FD. */
+int main(int argc, char* argv[])
+{
+  if (fcntl(OWNER_TEXT_FD, F_GETFD) < 0 || fcntl(OWNER_ACK_FD, F_GETFD) < 0) {
+    fprintf(stderr, "**tinyclipboard: %s is started by the tinyclipboard library, see tiny_clipowner(3).\n", argv[0]);
+    return 2;
+  }
+
+  if (argc > 1 && strcmp(argv[1], "--stats") == 0)
+    clip_inherit_stats(OWNER_STATS_FD);
+
+  signal(SIGINT, child_handle_sigint);
+  own_x11_clipboard(OWNER_TEXT_FD, OWNER_ACK_FD);
+
+  close(OWNER_TEXT_FD);
+  close(OWNER_ACK_FD);
+  return 0;
+}
@@ -0,0 +1,127 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+#ifdef __unix__
+/****************************************
+ * Pipes
+ ***************************************/
+
+/* Reads exactly `count' bytes from the non-blocking pipe `filedes',
+ * waiting for the writer if it has not yet written all of them. */
+bool clip_read_pipe(int filedes, void* buf, size_t count)
+{
+  char* p_target = (char*) buf;
+
+  while (count > 0) {
+    ssize_t ret = read(filedes, p_target, count);
+
+    if (ret > 0) {
+      p_target += ret;
+      count -= ret;
+    }
+    else if (ret < 0 && errno == EAGAIN) {
+      struct pollfd pfd;
+      pfd.fd = filedes;
+      pfd.events = POLLIN;
+      poll(&pfd, 1, -1);
+    }
+    else if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    else {
+      return false; /* EOF or error */
+    }
+  }
+
+  return true;
+}
+
+/* Writes all of `iov' into the pipe `filedes', which takes more than
+ * one call if it is larger than the pipe's buffer. SIGPIPE is blocked
+ * meanwhile, so that a reader gone away makes this fail with EPIPE
+ * instead of killing the process. Returns false on error, with errno
+ * set. */
+bool clip_write_pipe(int filedes, struct iovec* iov, int count)
+{
+  static const struct timespec no_wait = {0, 0};
+  bool result = true;
+  sigset_t sigpipe;
+  sigset_t oldmask;
+  sigset_t pending;
+  bool was_pending = false;
+
+  sigemptyset(&sigpipe);
+  sigaddset(&sigpipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe, &oldmask);
+  sigpending(&pending);
+  was_pending = sigismember(&pending, SIGPIPE);
+
+  while (count > 0) {
+    ssize_t ret = writev(filedes, iov, count);
+
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    else if (ret < 0) {
+      int errsv = errno;
+
+      /* Discard our own SIGPIPE, but not one that was pending before */
+      if (errsv == EPIPE && !was_pending)
+	sigtimedwait(&sigpipe, NULL, &no_wait);
+      errno = errsv;
+      result = false;
+      break;
+    }
+
+    while (count > 0 && (size_t) ret >= iov->iov_len) {
+      ret -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char*) iov->iov_base + ret;
+      iov->iov_len -= ret;
+    }
+  }
+
+  if (!sigismember(&oldmask, SIGPIPE))
+    pthread_sigmask(SIG_UNBLOCK, &sigpipe, NULL);
+  return result;
+}
+
+/* Waits up to X11_TIMEOUT seconds for the clipboard owner process to
+ * confirm a text with a single byte, which is stored in `p_ack'.
+ * Returns 1 on success, 0 if the owner process closed the pipe, and
+ * -1 on timeout. */
+int clip_read_ack(int filedes, char* p_ack)
+{
+  unsigned long long deadline = clip_monotonic_ns() + X11_TIMEOUT * 1000000000ULL;
+
+  for(;;) {
+    unsigned long long now = clip_monotonic_ns();
+    struct pollfd pfd;
+    ssize_t ret = 0;
+
+    if (now >= deadline)
+      return -1;
+
+    pfd.fd = filedes;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, (int)((deadline - now) / 1000000ULL) + 1) <= 0)
+      continue; /* Timeout or EINTR */
+
+    ret = read(filedes, p_ack, 1);
+    if (ret == 1)
+      return 1;
+    else if (ret == 0 || errno != EINTR)
+      return 0;
+  }
+}
+#endif
@@ -0,0 +1,370 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+#ifdef TINYCLIPBOARD_XFIXES
+#include <X11/extensions/Xfixes.h>
+#endif
+
+/* Prefetched clipboard text; see tiny_clipprefetch(). The slot holds
+ * the newest text, while borrowers may still hold older ones. */
+struct prefetched {
+  unsigned int refcount;
+  unsigned long generation;
+  int len;
+  char text[]; /* NUL-terminated */
+};
+
+static struct prefetched* s_p_prefetched = NULL;
+static bool s_prefetched_valid = false;      /* false while a change is being fetched */
+static unsigned long s_prefetch_generation = 0;
+static unsigned long s_prefetch_epoch = 0;  /* Counts changes of the clipboard */
+static int s_prefetch_maxlen = 0;           /* 0 if not prefetching; accessed atomically */
+static bool s_prefetch_notified = false;    /* Every change is reported; accessed atomically */
+static cliplock s_prefetch_lock = CLIPLOCK_INIT;
+static unsigned long invalidate_prefetched(void);
+static void publish_prefetched(const char* text, int len, unsigned long epoch);
+static void release_prefetched(struct prefetched* p_text);
+
+#ifdef __unix__
+/* Milliseconds between checks for a new CLIPBOARD owner when
+ * prefetching without XFixes */
+#define X11_PREFETCH_POLL 100
+
+/* Prefetch thread. Guarded by s_prefetch_thread_lock. */
+static cliplock s_prefetch_thread_lock = CLIPLOCK_INIT;
+static pthread_t s_prefetch_thread;
+static bool s_prefetch_running = false;
+static int s_prefetch_wakefds[2];
+static int prefetch_x11_clipboard(int maxlen);
+static void* run_x11_prefetch(void* arg);
+#endif
+
+/****************************************
+ * Public API
+ ***************************************/
+
+int tiny_clipprefetch(int maxlen)
+{
+  if (maxlen < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+#if defined(__unix__)
+  return prefetch_x11_clipboard(maxlen);
+#else
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+const char* tiny_clipborrow(int* len, unsigned long* p_generation)
+{
+  struct prefetched* p_text = NULL;
+
+  clip_lock_shared(&s_prefetch_lock);
+  if (s_prefetched_valid && s_p_prefetched) {
+    p_text = s_p_prefetched;
+    __atomic_fetch_add(&p_text->refcount, 1, __ATOMIC_RELAXED);
+  }
+  clip_unlock_shared(&s_prefetch_lock);
+
+  if (!p_text) {
+    errno = EAGAIN;
+    return NULL;
+  }
+
+  STAT_ADD(prefetch_hits, 1);
+  if (len)
+    *len = p_text->len;
+  if (p_generation)
+    *p_generation = p_text->generation;
+
+  return p_text->text;
+}
+
+void tiny_cliprelease(const char* text)
+{
+  if (text)
+    release_prefetched((struct prefetched*)(text - offsetof(struct prefetched, text)));
+}
+
+/****************************************
+ * Prefetching
+ ***************************************/
+
+/* Returns a copy of the prefetched text, or NULL if there is none
+ * that is known to be current. Without XFixes, the prefetch thread
+ * misses an owner replacing its text, so the text is only lent out
+ * by tiny_clipborrow() then, and reads ask the owner as usual. */
+char* read_prefetched(int* len)
+{
+  struct prefetched* p_text = NULL;
+  char* outbuf = NULL;
+
+  if (!__atomic_load_n(&s_prefetch_notified, __ATOMIC_ACQUIRE))
+    return NULL;
+
+  clip_lock_shared(&s_prefetch_lock);
+  if (s_prefetched_valid && s_p_prefetched) {
+    p_text = s_p_prefetched;
+    __atomic_fetch_add(&p_text->refcount, 1, __ATOMIC_RELAXED);
+  }
+  clip_unlock_shared(&s_prefetch_lock);
+
+  if (!p_text)
+    return NULL;
+
+  if ((outbuf = (char*) malloc(p_text->len + 1))) { /* Single = intended */
+    memcpy(outbuf, p_text->text, p_text->len + 1);
+    *len = p_text->len;
+    STAT_ADD(prefetch_hits, 1);
+  }
+
+  release_prefetched(p_text);
+  return outbuf;
+}
+
+/* Takes over `text', which this process just wrote to the native
+ * clipboard, as the prefetched text; there is no need to fetch it
+ * back. Does nothing if not prefetching. */
+void prefetch_written(const char* text, int len)
+{
+  if (__atomic_load_n(&s_prefetch_maxlen, __ATOMIC_ACQUIRE))
+    publish_prefetched(text, len, invalidate_prefetched());
+}
+
+/* Marks the prefetched text as outdated. Returns the epoch a new text
+ * for the change must be published with. */
+unsigned long invalidate_prefetched(void)
+{
+  unsigned long epoch = 0;
+
+  clip_lock_exclusive(&s_prefetch_lock);
+  s_prefetched_valid = false;
+  epoch = ++s_prefetch_epoch;
+  clip_unlock_exclusive(&s_prefetch_lock);
+
+  return epoch;
+}
+
+/* Makes `len' bytes of `text' the prefetched text, unless the
+ * clipboard has changed again since `epoch'. The generation only
+ * advances if the text differs from the previous one. */
+void publish_prefetched(const char* text, int len, unsigned long epoch)
+{
+  struct prefetched* p_new = NULL;
+  struct prefetched* p_old = NULL;
+
+  if (len > __atomic_load_n(&s_prefetch_maxlen, __ATOMIC_ACQUIRE))
+    return; /* Reads fetch it themselves */
+
+  /* Same text as before, e.g. the same owner announced itself again */
+  clip_lock_exclusive(&s_prefetch_lock);
+  if (epoch == s_prefetch_epoch && s_p_prefetched && s_p_prefetched->len == len
+      && memcmp(s_p_prefetched->text, text, len) == 0) {
+    s_prefetched_valid = true;
+    clip_unlock_exclusive(&s_prefetch_lock);
+    return;
+  }
+  clip_unlock_exclusive(&s_prefetch_lock);
+
+  /* Fill the back buffer without holding the lock */
+  if (!(p_new = (struct prefetched*) malloc(sizeof(struct prefetched) + len + 1))) /* Single = intended */
+    return;
+  p_new->refcount = 1; /* The slot's reference */
+  p_new->len = len;
+  memcpy(p_new->text, text, len);
+  p_new->text[len] = '\0';
+
+  clip_lock_exclusive(&s_prefetch_lock);
+  if (epoch == s_prefetch_epoch) {
+    p_new->generation = ++s_prefetch_generation;
+    p_old = s_p_prefetched;
+    s_p_prefetched = p_new;
+    s_prefetched_valid = true;
+  }
+  else {
+    p_old = p_new; /* Outdated already */
+  }
+  clip_unlock_exclusive(&s_prefetch_lock);
+
+  release_prefetched(p_old);
+}
+
+void release_prefetched(struct prefetched* p_text)
+{
+  if (p_text && __atomic_sub_fetch(&p_text->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    free(p_text);
+}
+
+/****************************************
+ * Prefetch thread for X11
+ ***************************************/
+
+#ifdef __unix__
+/* Starts, reconfigures or (with `maxlen' 0) stops the prefetch thread;
+ * see tiny_clipprefetch(). */
+int prefetch_x11_clipboard(int maxlen)
+{
+  int result = 0;
+
+  /* The thread uses Xlib alongside the caller's threads */
+  if (maxlen > 0 && !clip_initialized()) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  clip_lock_exclusive(&s_prefetch_thread_lock);
+  __atomic_store_n(&s_prefetch_maxlen, maxlen, __ATOMIC_RELEASE);
+
+  if (maxlen == 0 && s_prefetch_running) {
+    struct prefetched* p_old = NULL;
+
+    write(s_prefetch_wakefds[1], "q", 1);
+    pthread_join(s_prefetch_thread, NULL);
+    close(s_prefetch_wakefds[0]);
+    close(s_prefetch_wakefds[1]);
+    s_prefetch_running = false;
+    __atomic_store_n(&s_prefetch_notified, false, __ATOMIC_RELEASE);
+
+    invalidate_prefetched();
+    clip_lock_exclusive(&s_prefetch_lock);
+    p_old = s_p_prefetched;
+    s_p_prefetched = NULL;
+    clip_unlock_exclusive(&s_prefetch_lock);
+    release_prefetched(p_old);
+  }
+  else if (maxlen > 0 && s_prefetch_running) {
+    /* The text at hand might exceed the new limit; fetch it again. */
+    write(s_prefetch_wakefds[1], "r", 1);
+  }
+  else if (maxlen > 0) {
+    if (pipe(s_prefetch_wakefds) < 0) {
+      errno = EPIPE;
+      result = -1;
+    }
+    else if (pthread_create(&s_prefetch_thread, NULL, run_x11_prefetch, NULL) != 0) {
+      close(s_prefetch_wakefds[0]);
+      close(s_prefetch_wakefds[1]);
+      errno = EAGAIN;
+      result = -1;
+    }
+    else {
+      s_prefetch_running = true;
+    }
+
+    if (result < 0)
+      __atomic_store_n(&s_prefetch_maxlen, 0, __ATOMIC_RELEASE);
+  }
+
+  clip_unlock_exclusive(&s_prefetch_thread_lock);
+  return result;
+}
+
+/* Prefetch thread. Fetches CLIPBOARD whenever another client becomes
+ * its owner, which XFixes reports if available; otherwise the owner
+ * is polled for, which misses a new text from the same owner; see
+ * read_prefetched(). Texts written by this process are published by
+ * tiny_clipnwrite() directly. */
+void* run_x11_prefetch(void* arg)
+{
+  Display* p_display = XOpenDisplay(NULL);
+  int wakefd = s_prefetch_wakefds[0];
+  Window owner = None;
+  bool changed = true;
+  bool use_xfixes = false;
+  int xfixes_event = 0;
+  Atom clipboard;
+
+  if (!p_display) {
+    fprintf(stderr, "**tinyclipboard: Prefetching failed to open X11 display connection.\n");
+    return NULL;
+  }
+  STAT_ADD(x11_roundtrips, 1);
+
+  if ((clipboard = XInternAtom(p_display, "CLIPBOARD", False)) != None) /* Single = intended */
+    STAT_ADD(x11_roundtrips, 1);
+
+#ifdef TINYCLIPBOARD_XFIXES
+  {
+    int error_base = 0;
+
+    if (XFixesQueryExtension(p_display, &xfixes_event, &error_base)) {
+      XFixesSelectSelectionInput(p_display, XDefaultRootWindow(p_display), clipboard,
+				 XFixesSetSelectionOwnerNotifyMask
+				 | XFixesSelectionWindowDestroyNotifyMask
+				 | XFixesSelectionClientCloseNotifyMask);
+      xfixes_event += XFixesSelectionNotify;
+      use_xfixes = true;
+    }
+  }
+#endif
+  __atomic_store_n(&s_prefetch_notified, use_xfixes, __ATOMIC_RELEASE);
+
+  for(;;) {
+    int xfd = ConnectionNumber(p_display);
+    struct timeval tv;
+    fd_set fds;
+
+    if (!use_xfixes) {
+      Window current = XGetSelectionOwner(p_display, clipboard);
+
+      STAT_ADD(x11_roundtrips, 1);
+      if (current != owner) {
+	owner = current;
+	changed = true;
+      }
+    }
+
+    if (changed) {
+      unsigned long epoch = invalidate_prefetched();
+      int len = 0;
+      char* text = fetch_x11_clipboard(__atomic_load_n(&s_prefetch_maxlen, __ATOMIC_ACQUIRE), &len);
+
+      STAT_ADD(prefetch_fetches, 1);
+      if (text) {
+	publish_prefetched(text, len, epoch);
+	free(text);
+      }
+      changed = false;
+    }
+
+    FD_ZERO(&fds);
+    FD_SET(xfd, &fds);
+    FD_SET(wakefd, &fds);
+    tv.tv_sec = 0;
+    tv.tv_usec = X11_PREFETCH_POLL * 1000;
+
+    XFlush(p_display);
+    if (!XPending(p_display)
+	&& select((xfd > wakefd ? xfd : wakefd) + 1, &fds, NULL, NULL, use_xfixes ? NULL : &tv) > 0
+	&& FD_ISSET(wakefd, &fds)) {
+      char command = 0;
+
+      if (read(wakefd, &command, 1) != 1 || command == 'q')
+	break;
+      changed = true; /* 'r' */
+    }
+
+    while (XPending(p_display)) {
+      XEvent evt;
+      XNextEvent(p_display, &evt);
+
+      if (use_xfixes && evt.type == xfixes_event)
+	changed = true;
+    }
+  }
+
+  XCloseDisplay(p_display);
+  return NULL;
+}
+#endif
+
@@ -0,0 +1,270 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+/* Phases the owner process reached, kept for the parent to report;
+ * see clip_trace_owner(). The newest CLIP_OWNER_PHASES are kept. */
+#define CLIP_OWNER_PHASES 256
+
+struct clipownerphase {
+  unsigned long number;         /* Number of the phase plus one; 0 while it is written */
+  int phase;                    /* enum tiny_clipphase */
+  unsigned long long timestamp;
+};
+
+/* What the statistics mapping holds. All of it is accessed
+ * atomically, as the owner process shares it. */
+struct clipshared {
+  struct tiny_clipstats stats;
+  int tracing;                  /* Whether the parent has a trace callback */
+  unsigned long owner_phases;   /* Phases recorded so far */
+  struct clipownerphase phases[CLIP_OWNER_PHASES];
+};
+
+/* Statistics returned by tiny_clipstats(); see clip_stats(). */
+static struct clipshared s_local_shared;
+static struct clipshared* s_p_shared = NULL;
+#ifdef __unix__
+static int s_stats_fd = -1; /* File behind s_p_shared, if any */
+#endif
+static cliponce s_stats_once = CLIPONCE_INIT;
+
+/* Trace callback set with tiny_cliptrace() */
+static tiny_cliptracefunc s_trace_func = NULL;
+static void* s_p_trace_data = NULL;
+static cliplock s_trace_lock = CLIPLOCK_INIT;
+static unsigned long s_owner_reported = 0; /* Owner phases reported so far; accessed atomically */
+
+static void init_stats(void);
+static void report_owner_phases(tiny_cliptracefunc func, void* p_userdata);
+
+/****************************************
+ * Public API
+ ***************************************/
+
+void tiny_clipstats(struct tiny_clipstats* p_stats)
+{
+  *p_stats = *clip_stats();
+  clip_trace_pending();
+}
+
+void tiny_cliptrace(tiny_cliptracefunc func, void* p_userdata)
+{
+  struct clipshared* p_shared = NULL;
+
+  clip_stats();
+  p_shared = s_p_shared;
+
+  clip_lock_exclusive(&s_trace_lock);
+  __atomic_store_n(&s_trace_func, func, __ATOMIC_RELEASE);
+  s_p_trace_data = p_userdata;
+
+  /* Only what the owner process does from now on is news to `func' */
+  __atomic_store_n(&s_owner_reported, __atomic_load_n(&p_shared->owner_phases, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+  __atomic_store_n(&p_shared->tracing, func != NULL, __ATOMIC_RELEASE);
+  clip_unlock_exclusive(&s_trace_lock);
+}
+
+/****************************************
+ * Statistics and tracing
+ ***************************************/
+
+/* Returns the statistics counters. On Unix, they live in a shared
+ * mapping that is set up on first use, so that the counters updated
+ * by the clipboard owner process show up in the parent. If that
+ * fails, they are process-local. */
+struct tiny_clipstats* clip_stats(void)
+{
+  clip_run_once(&s_stats_once, init_stats);
+  return &s_p_shared->stats;
+}
+
+#ifdef __unix__
+/* Returns the descriptor of the file the statistics live in, for the
+ * owner process to map it as well, or -1 if there is none. */
+int clip_stats_fd(void)
+{
+  clip_stats();
+  return s_stats_fd;
+}
+
+/* Makes the statistics live in the file at `filedes' that the parent
+ * process set up; see main() in owner_main.c. Must be called before
+ * anything is counted. */
+void clip_inherit_stats(int filedes)
+{
+  s_stats_fd = filedes;
+}
+#endif
+
+void init_stats(void)
+{
+#ifdef __unix__
+  void* p_map = MAP_FAILED;
+  bool inherited = s_stats_fd >= 0; /* In tinyclipboard-owner; see clip_inherit_stats() */
+
+#ifdef MFD_CLOEXEC
+  /* A spawned owner process cannot inherit an anonymous mapping, but
+   * it can map the same file; see spawn_owner(). */
+  if (!inherited && (s_stats_fd = memfd_create("tinyclipboard-stats", MFD_CLOEXEC)) >= 0 /* Single = intended */
+      && ftruncate(s_stats_fd, sizeof(struct clipshared)) < 0) {
+    close(s_stats_fd);
+    s_stats_fd = -1;
+  }
+#endif
+
+  if (s_stats_fd >= 0 && (p_map = mmap(NULL, sizeof(struct clipshared), PROT_READ | PROT_WRITE, MAP_SHARED, s_stats_fd, 0)) == MAP_FAILED) { /* Single = intended */
+    close(s_stats_fd);
+    s_stats_fd = -1;
+    inherited = false;
+  }
+  if (s_stats_fd < 0)
+    p_map = mmap(NULL, sizeof(struct clipshared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+  if (p_map != MAP_FAILED) {
+    /* The inherited counters are the parent's and must stay */
+    if (!inherited)
+      memcpy(p_map, &s_local_shared, sizeof(struct clipshared));
+    s_p_shared = (struct clipshared*) p_map;
+  }
+  else {
+    s_p_shared = &s_local_shared;
+  }
+#else
+  s_p_shared = &s_local_shared;
+#endif
+}
+
+/* Reports reaching `phase' to the trace callback, if any. */
+void clip_trace(enum tiny_clipphase phase)
+{
+  tiny_cliptracefunc func = NULL;
+  void* p_userdata = NULL;
+
+  /* Tracing is usually off; do not take the lock then. */
+  if (!__atomic_load_n(&s_trace_func, __ATOMIC_ACQUIRE))
+    return;
+
+  clip_lock_shared(&s_trace_lock);
+  func = s_trace_func;
+  p_userdata = s_p_trace_data;
+  clip_unlock_shared(&s_trace_lock);
+
+  if (func) {
+    report_owner_phases(func, p_userdata);
+    func(phase, clip_monotonic_ns(), p_userdata);
+  }
+}
+
+/* Reports the phases the owner process reached since the last call
+ * to the trace callback, if any, with the times they happened at. */
+void clip_trace_pending(void)
+{
+  tiny_cliptracefunc func = NULL;
+  void* p_userdata = NULL;
+
+  if (!__atomic_load_n(&s_trace_func, __ATOMIC_ACQUIRE))
+    return;
+
+  clip_lock_shared(&s_trace_lock);
+  func = s_trace_func;
+  p_userdata = s_p_trace_data;
+  clip_unlock_shared(&s_trace_lock);
+
+  if (func)
+    report_owner_phases(func, p_userdata);
+}
+
+/* Records that the owner process reached `phase', for the parent to
+ * report from its next traced call; see report_owner_phases(). Does
+ * nothing unless the parent has a trace callback. The owner process
+ * runs a single thread, so there is only one writer. */
+void clip_trace_owner(enum tiny_clipphase phase)
+{
+  struct clipshared* p_shared = NULL;
+  struct clipownerphase* p_entry = NULL;
+  unsigned long number = 0;
+
+  clip_stats();
+  p_shared = s_p_shared;
+  if (!__atomic_load_n(&p_shared->tracing, __ATOMIC_ACQUIRE))
+    return;
+
+  number = __atomic_load_n(&p_shared->owner_phases, __ATOMIC_RELAXED);
+  p_entry = &p_shared->phases[number % CLIP_OWNER_PHASES];
+
+  __atomic_store_n(&p_entry->number, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&p_entry->phase, phase, __ATOMIC_RELAXED);
+  __atomic_store_n(&p_entry->timestamp, clip_monotonic_ns(), __ATOMIC_RELAXED);
+  __atomic_store_n(&p_entry->number, number + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&p_shared->owner_phases, number + 1, __ATOMIC_RELEASE);
+}
+
+/* Calls `func' for every phase the owner process recorded that has
+ * not been reported yet. Threads calling this at the same time each
+ * claim different phases. Phases that were overwritten before anybody
+ * got to them are skipped. */
+void report_owner_phases(tiny_cliptracefunc func, void* p_userdata)
+{
+  struct clipshared* p_shared = s_p_shared;
+  unsigned long next = __atomic_load_n(&s_owner_reported, __ATOMIC_ACQUIRE);
+
+  for(;;) {
+    unsigned long recorded = __atomic_load_n(&p_shared->owner_phases, __ATOMIC_ACQUIRE);
+    struct clipownerphase* p_entry = NULL;
+    unsigned long long timestamp = 0;
+    int phase = 0;
+    bool intact = false;
+
+    if (next == recorded)
+      return;
+
+    if (recorded - next > CLIP_OWNER_PHASES) {
+      /* Lost; start with the oldest still kept */
+      __atomic_compare_exchange_n(&s_owner_reported, &next, recorded - CLIP_OWNER_PHASES, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+      next = __atomic_load_n(&s_owner_reported, __ATOMIC_ACQUIRE);
+      continue;
+    }
+
+    p_entry = &p_shared->phases[next % CLIP_OWNER_PHASES];
+    if (__atomic_load_n(&p_entry->number, __ATOMIC_ACQUIRE) == next + 1) {
+      phase = __atomic_load_n(&p_entry->phase, __ATOMIC_RELAXED);
+      timestamp = __atomic_load_n(&p_entry->timestamp, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      intact = __atomic_load_n(&p_entry->number, __ATOMIC_RELAXED) == next + 1;
+    }
+
+    /* Claim it; on failure, `next' is what another thread left */
+    if (!__atomic_compare_exchange_n(&s_owner_reported, &next, next + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      continue;
+
+    if (intact)
+      func((enum tiny_clipphase) phase, timestamp, p_userdata);
+    next++;
+  }
+}
+
+/* Returns a monotonic timestamp in nanoseconds. */
+unsigned long long clip_monotonic_ns(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER counter;
+  LARGE_INTEGER frequency;
+
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (unsigned long long)(counter.QuadPart / (double)frequency.QuadPart * 1e9);
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
@@ -0,0 +1,212 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+#ifdef _WIN32
+/* Window class for the invisible clipboard window */
+static bool s_win32_class_registered = false;
+static cliponce s_win32_class_once = CLIPONCE_INIT;
+
+static void register_win32_class(void);
+LRESULT Win32MessageHandler(HWND window, UINT message, WPARAM wparam, LPARAM lparam);
+
+/****************************************
+ * Win32 backend
+ ***************************************/
+
+char* win32_clipread(int* len)
+{
+  HGLOBAL global_handle = NULL;
+  LPWSTR cliptext = NULL;
+  int bufsize = 0;
+  char* outbuf = NULL;
+
+  if (!IsClipboardFormatAvailable(CF_UNICODETEXT)) {
+    /* Unsupported data format */
+    errno = ENOTSUP;
+    return NULL;
+  }
+  if (!OpenClipboard(NULL)) {
+    /* Another application has the clipboard open */
+    errno = EAGAIN;
+    return NULL;
+  }
+
+  global_handle = GetClipboardData(CF_UNICODETEXT);
+  if (!global_handle) {
+    /* Clipboard owner lied before and has no unicode data */
+    CloseClipboard();
+    errno = ENOTSUP;
+    return NULL;
+  }
+
+  cliptext = GlobalLock(global_handle);
+  bufsize = WideCharToMultiByte(CP_UTF8, 0, cliptext, -1, NULL, 0, NULL, NULL);
+  if (!bufsize) {
+    /* There was invalid UTF-16 on the clipboard */
+    GlobalUnlock(global_handle);
+    CloseClipboard();
+    errno = EILSEQ;
+    return NULL;
+  }
+
+  outbuf = calloc(bufsize, 1);
+  bufsize = WideCharToMultiByte(CP_UTF8, 0, cliptext, -1, outbuf, bufsize, NULL, NULL);
+  if (!bufsize) {
+    /* This should not happen in theory */
+    free(outbuf);
+    GlobalUnlock(global_handle);
+    CloseClipboard();
+    errno = ECANCELED;
+    return NULL;
+  }
+
+  /* Cleanup */
+  GlobalUnlock(global_handle);
+  CloseClipboard();
+
+  if (len)
+    *len = bufsize;
+
+  return outbuf;
+}
+
+int win32_clipnwrite(const char* text, int len)
+{
+  HWND window = NULL;
+  HGLOBAL global_handle;
+  LPWSTR cliptext_utf16;
+  int charcount;
+  MSG message;
+  BOOL result;
+
+  /* Register our window class only on the first call */
+  clip_run_once(&s_win32_class_once, register_win32_class);
+  if (!s_win32_class_registered) {
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  window = CreateWindowW(L"TinyClipboardWindowClass", L"TinyClipboard window",
+			0, CW_USEDEFAULT,
+			CW_USEDEFAULT, CW_USEDEFAULT,
+			CW_USEDEFAULT, NULL, NULL,
+			NULL, NULL);
+  if (!window) {
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  UpdateWindow(window);
+
+  /* Acquire clipboard ownership. */
+  if (!OpenClipboard(window)) {
+    DestroyWindow(window);
+    errno = EAGAIN;
+    return -1;
+  }
+  EmptyClipboard();
+
+  /* Determine size of this in UTF-16 */
+  charcount = MultiByteToWideChar(CP_UTF8, 0, text, (int) len, NULL, 0);
+  if (!charcount) {
+    /* User passed invalid UTF-8 */
+    CloseClipboard();
+    DestroyWindow(window);
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Allocate system-global memory chunk. */
+  global_handle = GlobalAlloc(GMEM_MOVEABLE, charcount * sizeof(WCHAR) + 2); /* Terminating UTF-16 NUL-NUL */
+  cliptext_utf16 = GlobalLock(global_handle);
+
+  /* Write string as UTF-16 into the clipboard. */
+  memset(cliptext_utf16, '\0', charcount * sizeof(WCHAR) + 2);
+  charcount = MultiByteToWideChar(CP_UTF8, 0, text, (int) len, cliptext_utf16, charcount);
+  if (!charcount) {
+    GlobalFree(global_handle); /* probably includes GlobalUnlock() */
+    CloseClipboard();
+    DestroyWindow(window);
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Hand the pointer over to the OS, which will take care
+   * of freeing it and detaching it from this process so
+   * that is stays around even after the application has
+   * closed. */
+  if(!SetClipboardData(CF_UNICODETEXT, global_handle)) {
+    /* This should not happen. */
+    GlobalFree(global_handle);
+    CloseClipboard();
+    DestroyWindow(window);
+    errno = ECANCELED;
+    return -1;
+  }
+
+  /* Cleanup */
+  GlobalUnlock(global_handle);
+  CloseClipboard();
+
+  /* Tell the window to properly exit */
+  PostMessageW(window, WM_CLOSE, 0, 0);
+
+  /* Main loop */
+  while ((result = GetMessageW(&message, NULL, 0, 0)) != 0) {
+    if (result == -1) {
+      /* Very interesting. GetMessage() docs indicate that a BOOL
+       * type can actually be one of three values: -1, 0, nonzero.
+       * What was exactly the purpose of a BOOL then? */
+      DestroyWindow(window);
+      errno = ECANCELED;
+      return -1;
+    }
+
+    TranslateMessage(&message);
+    DispatchMessageW(&message);
+  }
+
+  return 0;
+}
+
+/****************************************
+ * Private helpers for Win32
+ ***************************************/
+
+void register_win32_class(void)
+{
+  WNDCLASSEXW windowclass;
+  memset(&windowclass, '\0', sizeof(WNDCLASSEX));
+
+  windowclass.cbSize = sizeof(WNDCLASSEX);
+  windowclass.lpfnWndProc = (WNDPROC) Win32MessageHandler;
+  windowclass.lpszClassName = L"TinyClipboardWindowClass";
+
+  s_win32_class_registered = RegisterClassExW(&windowclass) != 0;
+}
+
+LRESULT Win32MessageHandler(HWND window, UINT message, WPARAM wparam, LPARAM lparam)
+{
+  switch(message) {
+  case WM_NCCREATE:
+    return TRUE;
+  case WM_CREATE:
+    return 0;
+  case WM_CLOSE:
+    DestroyWindow(window);
+    return 0;
+  case WM_DESTROY:
+    PostQuitMessage(0);
+  default:
+    /* Do not process event by default */
+    return -1;
+  }
+}
+#endif
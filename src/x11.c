@@ -0,0 +1,712 @@
+/* tinyclipboard - a cross-platform C library for accessing the clipboard.
+ *
+ * Copyright © 2016 Marvin Gülker <m-guelker@guelkerdev.de>
+ *
+ * All rights reserved. See the README and LICENSE files for the
+ * licensing conditions.
+ */
+
+#include "internal.h"
+
+#ifdef __unix__
+/* Number of 32-bit units requested per XGetWindowProperty() call.
+ * Large enough that ordinary clipboard texts (up to 256 KiB) arrive
+ * with the very first request. */
+#define X11_PROPERTY_CHUNK 65536L
+
+/* Owner program started instead of forking a process with several
+ * threads, unless tiny_clipowner() named another or one is found next
+ * to the library; see find_owner_program(). `make' sets it to where
+ * `make install' puts it. */
+#ifndef TINYCLIPBOARD_OWNER_PATH
+#define TINYCLIPBOARD_OWNER_PATH "/usr/local/libexec/tinyclipboard-owner"
+#endif
+
+/* Environment variable naming the owner program */
+#define OWNER_PATH_VARIABLE "TINYCLIPBOARD_OWNER"
+
+extern char** environ; /* Passed on to a spawned owner process */
+static pid_t s_cb_pid = 0;
+static cliplock s_owner_lock = CLIPLOCK_INIT; /* Held while talking to the owner process */
+static char* s_owner_path = NULL;             /* See tiny_clipowner(); guarded by s_owner_lock */
+static int s_compress_threshold = 0;          /* See tiny_clipcompress(); accessed atomically */
+
+static int write_to_owner(const struct clipitem* p_items, int count);
+static bool may_fork_owner(void);
+static bool find_owner_program(char* path, size_t size);
+static void finish_subprocess_on_exit(void);
+static pid_t spawn_owner(const char* path, int textfd, int ackfd);
+static Bool is_selection_notify(Display* p_display, XEvent* p_evt, XPointer arg);
+static char* read_x11_property(Display* p_display, Window window, Atom property, int maxlen, int* p_len, Atom* p_type);
+static char* read_x11_incr(Display* p_display, Window window, Atom property, int maxlen, int* p_len);
+
+/****************************************
+ * X11 backend
+ ***************************************/
+
+char* x11_clipread(int* len)
+{
+  return fetch_x11_clipboard(INT_MAX - 1, len);
+}
+
+/* Reads CLIPBOARD, giving up with EOVERFLOW once it turns out to be
+ * larger than `maxlen' bytes. */
+char* fetch_x11_clipboard(int maxlen, int* len)
+{
+  static const char* atom_names[] = {"CLIPBOARD", "UTF8_STRING", "TINYCLIP_STORE", "INCR"};
+  Display* p_display = NULL;
+  Window window = None;
+  XEvent evt;
+  Atom atoms[4];
+  Atom clipboard;
+  Atom utf8;
+  Atom store_prop;
+  Atom incr;
+
+  /* Every reader has a connection of its own, so that concurrent
+   * readers do not wait for each other. */
+  p_display = XOpenDisplay(NULL);
+  if (!p_display) {
+    errno = ECONNREFUSED;
+    return NULL;
+  }
+  STAT_ADD(x11_roundtrips, 1);
+
+  /* Allocate atoms, all with a single request */
+  if (XInternAtoms(p_display, (char**) atom_names, 4, False, atoms))
+    STAT_ADD(x11_roundtrips, 1);
+  clipboard = atoms[0];  /* CLIPBOARD is the atom for the win32-like clipboard */
+  utf8 = atoms[1];       /* Resource for UTF-8 text */
+  store_prop = atoms[2]; /* Our custom window property for storage */
+  incr = atoms[3];       /* Type announcing a transfer in chunks */
+
+  /* Check if there is a clipboard owner that can answer me */
+  STAT_ADD(x11_roundtrips, 1);
+  if (XGetSelectionOwner(p_display, clipboard) == None) {
+    XCloseDisplay(p_display);
+    errno = EAGAIN;
+    return NULL;
+  }
+
+  /* Request selection content. Property changes on our window drive
+   * INCR transfers of large texts. */
+  window = XCreateSimpleWindow(p_display, XDefaultRootWindow(p_display), 0, 0, 1, 1, 0, 0, 0);
+  XSelectInput(p_display, window, PropertyChangeMask);
+  XConvertSelection(p_display, clipboard, utf8, store_prop, window, CurrentTime);
+  clip_trace(TINY_CLIPPHASE_READ_REQUEST);
+
+  /* X11 will send us a SelectionNotify event when the result
+   * is available from the owner. */
+  if (!wait_x11_event(p_display, &evt, is_selection_notify, NULL, X11_TIMEOUT)) {
+    XDestroyWindow(p_display, window);
+    XCloseDisplay(p_display);
+    errno = ETIMEDOUT;
+    return NULL;
+  }
+  STAT_ADD(x11_roundtrips, 1);
+  clip_trace(TINY_CLIPPHASE_READ_NOTIFY);
+
+  /* property is None here if the owner is unable to convert the
+   * selection to the requested format (UTF-8 text). */
+  if (evt.xselection.property == None) {
+    XDestroyWindow(p_display, window);
+    XCloseDisplay(p_display);
+    errno = ENOTSUP;
+    return NULL;
+  }
+  else {
+    char* outbuf = NULL;
+    int bytes = 0;
+    Atom type = None;
+    XEvent stale;
+
+    /* The owner writing the property left an event behind that must
+     * not be mistaken for the first INCR chunk. */
+    while (XCheckIfEvent(p_display, &stale, is_new_property, (XPointer)&store_prop))
+      ;
+
+    outbuf = read_x11_property(p_display, window, store_prop, maxlen, &bytes, &type);
+    if (outbuf && type == incr) {
+      /* Reading the INCR property deleted it, which started the transfer. */
+      free(outbuf);
+      outbuf = read_x11_incr(p_display, window, store_prop, maxlen, &bytes);
+    }
+
+    /* Cleanup */
+    XDestroyWindow(p_display, window);
+    XCloseDisplay(p_display);
+
+    /* Finish (errno is set by read_x11_property() on failure) */
+    if (outbuf && len)
+      *len = bytes;
+
+    return outbuf;
+  }
+}
+
+int x11_clipnwrite(const char* text, int len)
+{
+  struct clipitem item;
+
+  item.selection = TINY_CLIPSELECTION_CLIPBOARD;
+  item.target = NULL;
+  item.data = text;
+  item.len = len;
+
+  return x11_clipcommit(&item, 1);
+}
+
+int x11_clipcommit(const struct clipitem* p_items, int count)
+{
+  int result = 0;
+
+  /* There is only one clipboard owner process, so writers take turns
+   * talking to it. */
+  clip_lock_exclusive(&s_owner_lock);
+  result = write_to_owner(p_items, count);
+  clip_unlock_exclusive(&s_owner_lock);
+
+  return result;
+}
+
+int x11_clipcompress(int threshold)
+{
+  __atomic_store_n(&s_compress_threshold, threshold, __ATOMIC_RELAXED);
+  return 0;
+}
+
+int x11_clipowner(const char* path)
+{
+  char* p_copy = NULL;
+
+  if (path) {
+    if (access(path, X_OK) < 0)
+      return -1; /* errno is set by access() */
+
+    if (!(p_copy = malloc(strlen(path) + 1))) { /* Single = intended */
+      errno = ENOMEM;
+      return -1;
+    }
+    strcpy(p_copy, path);
+  }
+
+  /* Takes effect when the next owner process is started */
+  clip_lock_exclusive(&s_owner_lock);
+  free(s_owner_path);
+  s_owner_path = p_copy;
+  clip_unlock_exclusive(&s_owner_lock);
+
+  return 0;
+}
+
+/****************************************
+ * Private helpers for X11
+ ***************************************/
+
+/* Writes the `count' entries at `p_items' to the clipboard owner
+ * process as one record, creating the process if necessary. The
+ * caller must hold s_owner_lock. */
+int write_to_owner(const struct clipitem* p_items, int count)
+{
+  static unsigned short tries = 0;
+  static int pipefds[2];
+  static int ackfds[2];
+  static int has_registered_exit_handler = 0;
+
+  if (!s_cb_pid) { /* No clipboard handler process has been spawned yet. Do it now. */
+    Display* p_display = XOpenDisplay(NULL);
+
+    if (!p_display) { /* No X11 server running */
+      errno = ECONNREFUSED;
+      return -1;
+    }
+    else {
+      STAT_ADD(x11_roundtrips, 1);
+      XCloseDisplay(p_display);
+    }
+
+    if (tries++ > 3) {
+      /* 3 times in a row failed while recursing,
+       * fail finally to prevent endless recursion. */
+      tries = 0;
+      errno = ECHILD;
+      return -1;
+    }
+
+    /* Create child communication pipes: one for the texts, one for
+     * the child to confirm it owns the clipboard with them. */
+    if (pipe(pipefds) < 0) {
+      errno = EPIPE;
+      return -1;
+    }
+    if (pipe(ackfds) < 0) {
+      close(pipefds[0]);
+      close(pipefds[1]);
+      errno = EPIPE;
+      return -1;
+    }
+
+    /* I don't want this pipe to block; see get_clipboard_text(). */
+    fcntl(pipefds[0], F_SETFL, O_NONBLOCK);
+
+    /* Programs started by the caller must not keep the pipes open,
+     * or the owner process would outlive us. */
+    fcntl(pipefds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pipefds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(ackfds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ackfds[1], F_SETFD, FD_CLOEXEC);
+
+    /* The statistics must be set up before forking to be shared. */
+    clip_stats();
+
+    if (s_owner_path) {
+      s_cb_pid = spawn_owner(s_owner_path, pipefds[0], ackfds[1]);
+    }
+    else if (may_fork_owner()) {
+      s_cb_pid = fork();
+    }
+    else {
+      char path[PATH_MAX];
+
+      if (find_owner_program(path, sizeof(path)))
+	s_cb_pid = spawn_owner(path, pipefds[0], ackfds[1]);
+      else
+	s_cb_pid = -1; /* errno is ENOENT */
+    }
+
+    switch(s_cb_pid) {
+    case -1: {
+      /* fork or spawn failed, clean things up, keeping its errno. */
+      int error = errno;
+
+      s_cb_pid = 0;
+      close(pipefds[0]);
+      close(pipefds[1]);
+      close(ackfds[0]);
+      close(ackfds[1]);
+      errno = error;
+      return -1;
+    }
+    case 0: /* child */
+      /* Close pipe endings we do not use */
+      close(pipefds[1]);
+      close(ackfds[0]);
+
+      /* Loop */
+      signal(SIGINT, child_handle_sigint);
+      own_x11_clipboard(pipefds[0], ackfds[1]);
+
+      /* Cleanup and exit. exit() would run the atexit() handlers and
+       * flush the stdio buffers we inherited from the parent. */
+      close(pipefds[0]);
+      close(ackfds[1]);
+      _exit(0);
+      return 0; /* not reached */
+    default: /* parent */
+      STAT_ADD(forks, 1);
+
+      /* Close pipe endings we do not use */
+      close(pipefds[0]);
+      close(ackfds[1]);
+
+      /* Register our friendly process killer exactly once. */
+      if (!has_registered_exit_handler) {
+	atexit(finish_subprocess_on_exit);
+	has_registered_exit_handler = 1;
+      }
+
+      /* Recurse so we reach the other if branch */
+      return write_to_owner(p_items, count);
+    }
+  }
+  else { /* Existing clipboard handler process */
+    struct cliprecord record;
+    struct clipentry entries[CLIP_MAX_ITEMS];
+    struct iovec iov[1 + 3 * CLIP_MAX_ITEMS];
+    char ack = 0;
+    int n = 0;
+    int i;
+
+    if (waitpid(s_cb_pid, NULL, WNOHANG) != 0) {
+      /* Child process died, recreate it */
+      s_cb_pid = 0;
+      close(pipefds[1]);
+      close(ackfds[0]);
+      STAT_ADD(owner_respawns, 1);
+
+      return write_to_owner(p_items, count);
+    }
+
+    /* Write headers and data into the child process, all at once */
+    record.count = count;
+    record.compress_threshold = __atomic_load_n(&s_compress_threshold, __ATOMIC_RELAXED);
+    iov[n].iov_base = &record; /* yes, raw byte values! */
+    iov[n++].iov_len = sizeof(struct cliprecord);
+
+    for(i=0; i < count; i++) {
+      entries[i].selection = p_items[i].selection;
+      entries[i].namelen = p_items[i].target ? (int) strlen(p_items[i].target) : 0;
+      entries[i].len = p_items[i].len;
+
+      iov[n].iov_base = &entries[i];
+      iov[n++].iov_len = sizeof(struct clipentry);
+      iov[n].iov_base = (char*) p_items[i].target;
+      iov[n++].iov_len = entries[i].namelen;
+      iov[n].iov_base = (char*) p_items[i].data;
+      iov[n++].iov_len = entries[i].len;
+    }
+    if (!clip_write_pipe(pipefds[1], iov, n)) {
+      if (errno != EPIPE)
+	return -1;
+
+      /* Child died before reading everything, recreate it */
+      waitpid(s_cb_pid, NULL, 0);
+      s_cb_pid = 0;
+      close(pipefds[1]);
+      close(ackfds[0]);
+      STAT_ADD(owner_respawns, 1);
+
+      return write_to_owner(p_items, count);
+    }
+
+    /* Wait until the child owns the selections with the new data.
+     * Handing CLIPBOARD over to a clipboard manager continues in the
+     * background. */
+    switch (clip_read_ack(ackfds[0], &ack)) {
+    case 0: /* Child died meanwhile, recreate it */
+      waitpid(s_cb_pid, NULL, 0);
+      s_cb_pid = 0;
+      close(pipefds[1]);
+      close(ackfds[0]);
+      STAT_ADD(owner_respawns, 1);
+
+      return write_to_owner(p_items, count);
+    case -1: /* Child is wedged; its late answer would confuse the next call */
+      kill(s_cb_pid, SIGKILL);
+      waitpid(s_cb_pid, NULL, 0);
+      s_cb_pid = 0;
+      close(pipefds[1]);
+      close(ackfds[0]);
+      errno = ETIMEDOUT;
+      return -1;
+    default:
+      break;
+    }
+
+    if (ack != 0) {
+      /* Another client grabbed a selection in the very same moment */
+      errno = EAGAIN;
+      return -1;
+    }
+
+    clip_trace(TINY_CLIPPHASE_WRITE_OWNER);
+    tries = 0; /* Reset process death counter */
+    return 0;
+  }
+}
+
+/* Tells whether the owner process may be forked. The child of a
+ * process with several threads only has the calling one, and locks
+ * the others held at the time, in Xlib or in the C library, stay
+ * locked for good. Where /proc does not tell how many threads there
+ * are, a call to tiny_clipinit() is taken to mean there are several. */
+bool may_fork_owner(void)
+{
+  FILE* p_file = NULL;
+  char line[128];
+  int threads = 0;
+
+  if ((p_file = fopen("/proc/self/status", "r"))) { /* Single = intended */
+    while (fgets(line, sizeof(line), p_file)) {
+      if (sscanf(line, "Threads: %d", &threads) == 1)
+	break;
+    }
+    fclose(p_file);
+  }
+
+  if (threads > 0)
+    return threads == 1;
+  else
+    return !clip_initialized();
+}
+
+/* Finds the owner program to start if tiny_clipowner() named none.
+ * Looks at the OWNER_PATH_VARIABLE environment variable, then next to
+ * the file the library was loaded from (the shared library, or the
+ * program it is linked into) and in ../libexec and .. from there,
+ * which also finds it in the build tree, and finally at
+ * TINYCLIPBOARD_OWNER_PATH. Returns false with errno set to ENOENT if
+ * none of these is executable. */
+bool find_owner_program(char* path, size_t size)
+{
+  static const char* relative[] = {"/tinyclipboard-owner", "/../libexec/tinyclipboard-owner", "/../tinyclipboard-owner"};
+  unsigned long here = (unsigned long) &find_owner_program;
+  const char* p_env = NULL;
+  FILE* p_file = NULL;
+  char line[PATH_MAX + 128];
+  char dir[PATH_MAX] = "";
+  size_t i;
+
+#ifdef __GLIBC__
+  p_env = secure_getenv(OWNER_PATH_VARIABLE); /* Not for set-user-ID programs */
+#else
+  p_env = getenv(OWNER_PATH_VARIABLE);
+#endif
+  if (p_env && *p_env && strlen(p_env) < size && access(p_env, X_OK) == 0) {
+    strcpy(path, p_env);
+    return true;
+  }
+
+  /* The mapping our code lives in tells where we were loaded from */
+  if ((p_file = fopen("/proc/self/maps", "r"))) { /* Single = intended */
+    while (fgets(line, sizeof(line), p_file)) {
+      unsigned long start = 0;
+      unsigned long end = 0;
+      char* p_path = strchr(line, '/');
+      char* p_slash = NULL;
+
+      if (sscanf(line, "%lx-%lx", &start, &end) != 2 || here < start || here >= end || !p_path)
+	continue;
+
+      p_path[strcspn(p_path, "\n")] = '\0';
+      if ((p_slash = strrchr(p_path, '/')) && p_slash > p_path) { /* Single = intended */
+	*p_slash = '\0';
+	strcpy(dir, p_path);
+      }
+      break;
+    }
+    fclose(p_file);
+  }
+
+  for(i=0; *dir && i < sizeof(relative) / sizeof(relative[0]); i++) {
+    if (strlen(dir) + strlen(relative[i]) < size) {
+      sprintf(path, "%s%s", dir, relative[i]);
+      if (access(path, X_OK) == 0)
+	return true;
+    }
+  }
+
+  if (strlen(TINYCLIPBOARD_OWNER_PATH) < size && access(TINYCLIPBOARD_OWNER_PATH, X_OK) == 0) {
+    strcpy(path, TINYCLIPBOARD_OWNER_PATH);
+    return true;
+  }
+
+  errno = ENOENT;
+  return false;
+}
+
+void finish_subprocess_on_exit(void)
+{
+  if (s_cb_pid) {
+    /* Initiate civilised shutdown in clipboard owner process. */
+    kill(s_cb_pid, SIGINT);
+    waitpid(s_cb_pid, NULL, 0);
+  }
+
+  /* FIXME: Does not close parent process' pipe ending. This
+   * should be done here. But hey, we are exiting anyway, and
+   * this way I don't need an extra file-static variable... */
+}
+
+/* Starts the program at `path' as the clipboard owner process instead
+ * of forking; see tiny_clipowner(). It finds `textfd' at
+ * OWNER_TEXT_FD, `ackfd' at OWNER_ACK_FD and, if the statistics are
+ * backed by a file, that at OWNER_STATS_FD. posix_spawn() does not
+ * copy our address space, so this costs the same however large the
+ * parent is. Returns the process ID, or -1 with errno set on failure
+ * (ENOENT or EACCES if `path' cannot be run). */
+pid_t spawn_owner(const char* path, int textfd, int ackfd)
+{
+  static const int defaults[] = {SIGINT, SIGTERM, SIGHUP, SIGPIPE};
+  int statsfd = clip_stats_fd();
+  int fds[3] = {textfd, ackfd, statsfd};
+  int targets[3] = {OWNER_TEXT_FD, OWNER_ACK_FD, OWNER_STATS_FD};
+  char* argv[3] = {(char*) "tinyclipboard-owner", NULL, NULL};
+  int count = statsfd >= 0 ? 3 : 2;
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t sigs;
+  pid_t pid = -1;
+  int error = 0;
+  int i;
+
+  /* Moving a descriptor onto one that is still to be moved would lose
+   * the latter, so move copies out of the way first. The copies are
+   * closed on exec. */
+  for(i=0; i < count; i++) {
+    if ((fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, OWNER_STATS_FD + 1)) < 0) { /* Single = intended */
+      while (i-- > 0)
+	close(fds[i]);
+      return -1;
+    }
+  }
+  if (count > 2)
+    argv[1] = (char*) "--stats";
+
+  posix_spawn_file_actions_init(&actions);
+  for(i=0; i < count; i++)
+    posix_spawn_file_actions_adddup2(&actions, fds[i], targets[i]);
+
+  /* Whatever signal handling the caller set up is not the owner's */
+  posix_spawnattr_init(&attr);
+  sigemptyset(&sigs);
+  posix_spawnattr_setsigmask(&attr, &sigs);
+  for(i=0; i < (int)(sizeof(defaults) / sizeof(defaults[0])); i++)
+    sigaddset(&sigs, defaults[i]);
+  posix_spawnattr_setsigdefault(&attr, &sigs);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+  if ((error = posix_spawn(&pid, path, &actions, &attr, argv, environ)) != 0) /* Single = intended */
+    pid = -1;
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  for(i=0; i < count; i++)
+    close(fds[i]);
+
+  if (error)
+    errno = error;
+  return pid;
+}
+
+/* Predicates for wait_x11_event(). */
+Bool is_selection_notify(Display* p_display, XEvent* p_evt, XPointer arg)
+{
+  return p_evt->type == SelectionNotify;
+}
+
+/* Reads the entire content of `property' on `window' into a newly
+ * allocated, NUL-terminated buffer and deletes the property. The first
+ * request asks for X11_PROPERTY_CHUNK units at once, so that typical
+ * texts are retrieved with a single round trip; only if the server
+ * reports remaining bytes are further requests issued for the
+ * rest. The property's type is returned in `p_type'. Returns NULL and
+ * sets errno on failure, which includes the property being larger
+ * than `maxlen' bytes. */
+char* read_x11_property(Display* p_display, Window window, Atom property, int maxlen, int* p_len, Atom* p_type)
+{
+  int actual_format = 0;
+  unsigned long nitems = 0;
+  unsigned long bytes_left = 0;
+  unsigned char* p_data = NULL;
+  long offset = 0; /* in 32-bit units as required by XGetWindowProperty() */
+  char* outbuf = NULL;
+  unsigned long total = 0;
+  unsigned long capacity = 0;
+
+  do {
+    unsigned long chunklen = 0;
+
+    if (XGetWindowProperty(p_display, window, property,
+			   offset, X11_PROPERTY_CHUNK, False,
+			   AnyPropertyType, p_type, &actual_format,
+			   &nitems, &bytes_left, &p_data) != Success) {
+      /* In theory, we should never get here */
+      free(outbuf);
+      errno = ECANCELED;
+      return NULL;
+    }
+    STAT_ADD(x11_roundtrips, 1);
+
+    /* Text is transferred with format 8, i.e. nitems are bytes. */
+    chunklen = nitems * (actual_format / 8);
+
+    /* `maxlen' is at most INT_MAX - 1, as int is the largest common type */
+    if (total + chunklen + bytes_left > (unsigned long) maxlen) {
+      XFree(p_data);
+      free(outbuf);
+      errno = EOVERFLOW;
+      return NULL;
+    }
+
+    /* After the first request the total size is known, so this
+     * allocates exactly once unless the property grows meanwhile. */
+    if (total + chunklen + bytes_left + 1 > capacity) {
+      char* p_new = NULL;
+
+      capacity = total + chunklen + bytes_left + 1;
+      if (!(p_new = (char*) realloc(outbuf, capacity))) { /* Single = intended */
+	XFree(p_data);
+	free(outbuf);
+	errno = ENOMEM;
+	return NULL;
+      }
+      outbuf = p_new;
+    }
+
+    if (chunklen > 0)
+      memcpy(outbuf + total, p_data, chunklen);
+    total += chunklen;
+    offset += chunklen / 4;
+
+    XFree(p_data);
+    p_data = NULL;
+  } while (bytes_left > 0 && nitems > 0);
+
+  /* Protocol etiquette: the requestor deletes the property after
+   * reading. For INCR transfers, this requests the next chunk. */
+  XDeleteProperty(p_display, window, property);
+
+  outbuf[total] = '\0';
+  *p_len = (int) total; /* INT_MAX checked above */
+  return outbuf;
+}
+
+/* Receives an INCR transfer (ICCCM section 2.7.2) on `property' of
+ * `window', which must have PropertyChangeMask selected. The INCR
+ * property announcing the transfer must have been read (and thus
+ * deleted) already. Returns NULL and sets errno on failure, which
+ * includes the transfer exceeding `maxlen' bytes. */
+char* read_x11_incr(Display* p_display, Window window, Atom property, int maxlen, int* p_len)
+{
+  char* outbuf = NULL;
+  int total = 0;
+
+  for(;;) {
+    XEvent evt;
+    Atom type = None;
+    char* chunk = NULL;
+    char* p_new = NULL;
+    int chunklen = 0;
+
+    /* The owner announces each chunk by changing the property. */
+    if (!wait_x11_event(p_display, &evt, is_new_property, (XPointer)&property, X11_TIMEOUT)) {
+      free(outbuf);
+      errno = ETIMEDOUT;
+      return NULL;
+    }
+
+    if (!(chunk = read_x11_property(p_display, window, property, maxlen - total, &chunklen, &type))) { /* Single = intended */
+      free(outbuf);
+      return NULL; /* errno set by read_x11_property() */
+    }
+
+    /* A zero-length chunk ends the transfer. */
+    if (chunklen == 0) {
+      free(chunk);
+      break;
+    }
+
+    if (!(p_new = (char*) realloc(outbuf, total + chunklen + 1))) { /* Single = intended */
+      free(chunk);
+      free(outbuf);
+      errno = ENOMEM;
+      return NULL;
+    }
+
+    outbuf = p_new;
+    memcpy(outbuf + total, chunk, chunklen);
+    total += chunklen;
+    free(chunk);
+  }
+
+  if (!outbuf && !(outbuf = (char*) malloc(1))) { /* Single = intended */
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  outbuf[total] = '\0';
+  *p_len = total;
+  return outbuf;
+}
+#endif